@@ -0,0 +1,290 @@
+#include "bignum.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Benchmarks for mp::bignum and mp::polynomial. Every measured result is
+// cross-checked against a slow reference before it is timed.
+
+namespace {
+    double const MIN_SECONDS = 0.2;
+    size_t const DECIMAL_REFERENCE_LIMIT = 256;
+    size_t const DECIMAL_LIMIT = 2048;
+
+    std::mt19937 rng(42);
+    bool failed = false;
+
+    void print_error(std::string const& program_name, std::string const& message) {
+        std::string usage = "\nUsage: " + program_name + " [max limbs] [threads]";
+        std::cout << message << usage << std::endl;
+    }
+
+    // Schoolbook arithmetic on decimal strings, independent of bignum internals.
+    std::string reference_add(std::string const& a, std::string const& b) {
+        std::string result;
+        int carry = 0;
+        for (size_t i = 0; i < std::max(a.size(), b.size()) || carry != 0; ++i) {
+            int cur = carry;
+            cur += (i < a.size() ? a[a.size() - 1 - i] - '0' : 0);
+            cur += (i < b.size() ? b[b.size() - 1 - i] - '0' : 0);
+            result.push_back(static_cast<char>(cur % 10 + '0'));
+            carry = cur / 10;
+        }
+        while (result.size() > 1 && result.back() == '0') {
+            result.pop_back();
+        }
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+    std::string reference_mul(std::string const& a, std::string const& b) {
+        std::vector<uint32_t> digits(a.size() + b.size(), 0);
+        for (size_t i = 0; i < a.size(); ++i) {
+            for (size_t j = 0; j < b.size(); ++j) {
+                digits[i + j] += (a[a.size() - 1 - i] - '0') * (b[b.size() - 1 - j] - '0');
+            }
+            for (size_t k = i; k < digits.size() - 1; ++k) {
+                digits[k + 1] += digits[k] / 10;
+                digits[k] %= 10;
+            }
+        }
+        std::string result;
+        for (auto d : digits) {
+            result.push_back(static_cast<char>(d + '0'));
+        }
+        while (result.size() > 1 && result.back() == '0') {
+            result.pop_back();
+        }
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+    mp::bignum random_bignum(size_t limbs) {
+        std::vector<unsigned char> bytes(limbs * sizeof(uint32_t));
+        for (auto& byte : bytes) {
+            byte = static_cast<unsigned char>(rng());
+        }
+        bytes.back() |= 1;
+        return mp::bignum::from_bytes(bytes.data(), bytes.size());
+    }
+
+    std::string random_hex(size_t digits) {
+        char const* hex_digits = "0123456789abcdef";
+        std::string result(1, hex_digits[1 + rng() % 15]);
+        while (result.size() < digits) {
+            result.push_back(hex_digits[rng() % 16]);
+        }
+        return result;
+    }
+
+    std::string random_decimal(size_t digits) {
+        std::string result(1, static_cast<char>('1' + rng() % 9));
+        while (result.size() < digits) {
+            result.push_back(static_cast<char>('0' + rng() % 10));
+        }
+        return result;
+    }
+
+    size_t decimal_digits(size_t limbs) {
+        return limbs * 9633 / 1000;
+    }
+
+    void check(bool ok, std::string const& what, size_t size) {
+        if (!ok) {
+            std::cout << "MISMATCH: " << what << " at " << size << " limbs" << std::endl;
+            failed = true;
+        }
+    }
+
+    // Runs op until MIN_SECONDS elapsed and reports the time per operation.
+    template<typename Op>
+    void measure(std::string const& name, size_t limbs, Op op) {
+        using clock = std::chrono::steady_clock;
+        size_t iterations = 0;
+        auto start = clock::now();
+        double elapsed = 0;
+        do {
+            op();
+            ++iterations;
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        } while (elapsed < MIN_SECONDS);
+
+        double ns_per_op = elapsed * 1e9 / iterations;
+        double limbs_per_s = limbs * iterations / elapsed;
+        std::cout << std::left << std::setw(14) << name
+            << std::right << std::setw(10) << limbs
+            << std::setw(16) << std::fixed << std::setprecision(1) << ns_per_op
+            << std::setw(16) << std::scientific << std::setprecision(3) << limbs_per_s
+            << std::defaultfloat << std::endl;
+    }
+
+    void bench_add(size_t limbs) {
+        if (limbs <= DECIMAL_REFERENCE_LIMIT) {
+            std::string a = random_decimal(decimal_digits(limbs));
+            std::string b = random_decimal(decimal_digits(limbs));
+            check((mp::bignum(a) + mp::bignum(b)).to_string() == reference_add(a, b), "add", limbs);
+        }
+        mp::bignum a = random_bignum(limbs);
+        mp::bignum b = random_bignum(limbs);
+        mp::bignum c;
+        measure("add", limbs, [&] { c = a; c += b; });
+    }
+
+    void bench_mul(size_t limbs, unsigned threads) {
+        if (limbs <= DECIMAL_REFERENCE_LIMIT) {
+            std::string a = random_decimal(decimal_digits(limbs));
+            std::string b = random_decimal(decimal_digits(limbs));
+            check((mp::bignum(a) * mp::bignum(b)).to_string() == reference_mul(a, b), "mul", limbs);
+        }
+        mp::bignum a = random_bignum(limbs);
+        mp::bignum b = random_bignum(limbs);
+
+        mp::set_multiplication_threads(1);
+        mp::bignum single = a * b;
+        mp::set_multiplication_threads(threads);
+        mp::bignum c = a * b;
+        check(c == single, "mul thread determinism", limbs);
+        check(a * (b + 1) == c + a, "mul distributivity", limbs);
+
+        measure("mul", limbs, [&] { c = a * b; });
+    }
+
+    void bench_decimal(size_t limbs) {
+        std::string src = random_decimal(decimal_digits(limbs));
+        mp::bignum n(src);
+        check(n.to_string() == src, "to_string", limbs);
+        measure("to_string", limbs, [&] { src = n.to_string(); });
+        measure("parse", limbs, [&] { n = mp::bignum(src); });
+    }
+
+    void bench_hex(size_t limbs) {
+        if (limbs <= DECIMAL_REFERENCE_LIMIT) {
+            std::string src = random_decimal(decimal_digits(limbs));
+            std::stringstream ss;
+            ss << std::hex << mp::bignum(src);
+            check(mp::bignum::from_hex(ss.str()).to_string() == src, "hex vs decimal", limbs);
+        }
+        std::string src = random_hex(8 * limbs);
+        mp::bignum n = mp::bignum::from_hex(src);
+        check(n.to_hex() == src, "to_hex", limbs);
+        measure("to_hex", limbs, [&] { src = n.to_hex(); });
+        measure("from_hex", limbs, [&] { n = mp::bignum::from_hex(src); });
+    }
+
+    void bench_bytes(size_t limbs) {
+        mp::bignum n = random_bignum(limbs);
+        std::vector<unsigned char> bytes(n.byte_size());
+        n.to_bytes(bytes.data());
+        check(mp::bignum::from_bytes(bytes.data(), bytes.size()) == n, "bytes", limbs);
+
+        std::stringstream ss;
+        n.write(ss);
+        check(mp::bignum::read(ss) == n, "stream", limbs);
+
+        measure("to_bytes", limbs, [&] { n.to_bytes(bytes.data()); });
+        measure("from_bytes", limbs, [&] { n = mp::bignum::from_bytes(bytes.data(), bytes.size()); });
+    }
+
+    void bench_polynomial(size_t degree, size_t limbs) {
+        std::string src;
+        for (size_t i = degree + 1; i > 0; --i) {
+            src += std::to_string(rng()) + "^" + std::to_string(i - 1) + (i > 1 ? "+" : "");
+        }
+        mp::polynomial p(src);
+        mp::bignum point = random_bignum(limbs);
+
+        mp::bignum expected;
+        mp::bignum power = 1;
+        for (size_t i = 0; i <= degree; ++i) {
+            expected += power * p.at(i);
+            power *= point;
+        }
+        mp::bignum result = p(point);
+        check(result == expected, "polynomial", degree);
+
+        measure("poly eval", degree, [&] { result = p(point); });
+    }
+
+    void bench_polynomial_ops(size_t terms) {
+        std::vector<size_t> order(terms);
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), rng);
+        std::string src;
+        std::vector<uint32_t> coeffs(terms);
+        for (size_t pow : order) {
+            coeffs[pow] = static_cast<uint32_t>(rng());
+            src += (src.empty() ? "" : "+") + std::to_string(coeffs[pow]) + "^" + std::to_string(pow);
+        }
+        mp::polynomial a(src);
+        mp::polynomial b;
+        for (size_t i = 0; i < terms; ++i) {
+            check(a.at(i) == coeffs[i], "polynomial parse", terms);
+            b.at(i) = static_cast<uint32_t>(rng());
+        }
+
+        mp::polynomial product = a * b;
+        if (terms <= 4096) {
+            std::vector<uint32_t> expected(2 * terms - 1, 0);
+            for (size_t i = 0; i < terms; ++i) {
+                for (size_t j = 0; j < terms; ++j) {
+                    expected[i + j] += a.at(i) * b.at(j);
+                }
+            }
+            for (size_t i = 0; i < expected.size(); ++i) {
+                check(product.at(i) == expected[i], "polynomial mul", terms);
+            }
+        }
+        check(a(3u) * b(3u) == product(3u), "polynomial mul at a point", terms);
+
+        measure("poly parse", terms, [&] { a = mp::polynomial(src); });
+        measure("poly add", terms, [&] { product = a + b; });
+        measure("poly mul", terms, [&] { product = a * b; });
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 3) {
+        print_error(argv[0], "Wrong number of arguments!");
+        return 0;
+    }
+    size_t max_limbs = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1 << 16);
+    unsigned threads = (argc > 2 ? std::strtoul(argv[2], nullptr, 10) : mp::multiplication_threads());
+    if (max_limbs == 0 || threads == 0) {
+        print_error(argv[0], "Invalid arguments!");
+        return 0;
+    }
+
+    std::cout << std::left << std::setw(14) << "operation"
+        << std::right << std::setw(10) << "size"
+        << std::setw(16) << "ns/op"
+        << std::setw(16) << "limbs/s" << std::endl;
+
+    for (size_t limbs = 1; limbs <= max_limbs; limbs *= 4) {
+        bench_add(limbs);
+    }
+    for (size_t limbs = 1; limbs <= max_limbs; limbs *= 2) {
+        bench_mul(limbs, threads);
+    }
+    for (size_t limbs = 1; limbs <= std::min(max_limbs, DECIMAL_LIMIT); limbs *= 4) {
+        bench_decimal(limbs);
+    }
+    for (size_t limbs = 1; limbs <= max_limbs; limbs *= 16) {
+        bench_hex(limbs);
+        bench_bytes(limbs);
+    }
+    for (size_t degree = 4; degree <= 256; degree *= 4) {
+        bench_polynomial(degree, 4);
+    }
+    for (size_t terms = 16; terms <= std::min<size_t>(max_limbs, 1 << 16); terms *= 4) {
+        bench_polynomial_ops(terms);
+    }
+
+    return failed ? 1 : 0;
+}
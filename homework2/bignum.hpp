@@ -2,58 +2,286 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <memory_resource>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 namespace mp {
+    ///////////////// MULTIPLICATION
+
+    namespace detail {
+        size_t const KARATSUBA_THRESHOLD = 32;
+        size_t const PARALLEL_THRESHOLD = 8192;
+        size_t const READ_CHUNK = 65536;
+
+        inline std::atomic<unsigned>& multiplication_threads() {
+            static std::atomic<unsigned> threads(std::max(1u, std::thread::hardware_concurrency()));
+            return threads;
+        }
+
+        inline bool little_endian() {
+            uint32_t const probe = 1;
+            unsigned char first = 0;
+            std::memcpy(&first, &probe, 1);
+            return first == 1;
+        }
+
+        inline int hex_value(char c) {
+            if (c >= '0' && c <= '9') {
+                return c - '0';
+            }
+            if (c >= 'a' && c <= 'f') {
+                return c - 'a' + 10;
+            }
+            if (c >= 'A' && c <= 'F') {
+                return c - 'A' + 10;
+            }
+            return -1;
+        }
+
+        inline size_t trimmed(uint32_t const* a, size_t n) {
+            while (n > 0 && a[n - 1] == 0) {
+                --n;
+            }
+            return n;
+        }
+
+        // r[0, rn) += a[0, an), an <= rn. Returns the carry out of r.
+        inline uint32_t add_to(uint32_t* r, size_t rn, uint32_t const* a, size_t an) {
+            uint64_t carry = 0;
+            size_t i = 0;
+            for (; i < an; ++i) {
+                carry += static_cast<uint64_t>(r[i]) + a[i];
+                r[i] = static_cast<uint32_t>(carry);
+                carry >>= 32;
+            }
+            for (; carry != 0 && i < rn; ++i) {
+                carry += r[i];
+                r[i] = static_cast<uint32_t>(carry);
+                carry >>= 32;
+            }
+            return static_cast<uint32_t>(carry);
+        }
+
+        // r[0, rn) -= a[0, an), an <= rn and r >= a.
+        inline void sub_from(uint32_t* r, size_t rn, uint32_t const* a, size_t an) {
+            uint64_t borrow = 0;
+            size_t i = 0;
+            for (; i < an; ++i) {
+                uint64_t cur = static_cast<uint64_t>(r[i]) - a[i] - borrow;
+                r[i] = static_cast<uint32_t>(cur);
+                borrow = cur >> 63;
+            }
+            for (; borrow != 0 && i < rn; ++i) {
+                borrow = (r[i] == 0);
+                --r[i];
+            }
+        }
+
+        // r[0, an + bn) += a * b.
+        inline void mul_basecase(uint32_t const* a, size_t an, uint32_t const* b, size_t bn, uint32_t* r) {
+            for (size_t i = 0; i < an; ++i) {
+                uint64_t carry = 0;
+                for (size_t j = 0; j < bn; ++j) {
+                    carry += r[i + j] + static_cast<uint64_t>(a[i]) * b[j];
+                    r[i + j] = static_cast<uint32_t>(carry);
+                    carry >>= 32;
+                }
+                r[i + bn] = static_cast<uint32_t>(carry);
+            }
+        }
+
+        // Runs every task with a share of the thread budget, which bounds the
+        // threads running at once. Tasks after the first get their own thread
+        // while the budget lasts; the rest run inline after the first one.
+        template<typename First, typename... Rest>
+        void fork_join(unsigned threads, First&& first, Rest&&... rest) {
+            if (threads <= 1) {
+                first(1u);
+                (rest(1u), ...);
+                return;
+            }
+            unsigned const share = std::max(1u, threads / static_cast<unsigned>(sizeof...(Rest) + 1));
+            std::vector<std::future<void>> futures;
+            futures.reserve(sizeof...(Rest));
+            auto spawn = [&](auto& task) {
+                if (futures.size() + 1 >= threads) {
+                    return false;
+                }
+                futures.push_back(std::async(std::launch::async, std::ref(task), share));
+                return true;
+            };
+            bool const spawned[] = {spawn(rest)...};
+            first(std::max(1u, threads - share * static_cast<unsigned>(futures.size())));
+            size_t i = 0;
+            ((spawned[i++] ? void() : rest(1u)), ...);
+            for (auto& future : futures) {
+                future.get();
+            }
+        }
+
+        // r[0, an + bn) = a * b, r must be zeroed. Karatsuba above the threshold,
+        // the three subproducts of large operands run in parallel.
+        inline void multiply(uint32_t const* a, size_t an, uint32_t const* b, size_t bn, uint32_t* r, unsigned threads) {
+            if (an < bn) {
+                std::swap(a, b);
+                std::swap(an, bn);
+            }
+            if (bn < KARATSUBA_THRESHOLD) {
+                mul_basecase(a, an, b, bn, r);
+                return;
+            }
+            if (an + bn < PARALLEL_THRESHOLD) {
+                threads = 1;
+            }
+
+            size_t const m = an - an / 2;
+            if (bn <= m) {
+                std::vector<uint32_t> high(an - m + bn, 0);
+                fork_join(threads,
+                    [&](unsigned t) { multiply(a, m, b, bn, r, t); },
+                    [&](unsigned t) { multiply(a + m, an - m, b, bn, high.data(), t); });
+                add_to(r + m, an + bn - m, high.data(), high.size());
+                return;
+            }
+
+            std::vector<uint32_t> sa(a, a + m + 1);
+            std::vector<uint32_t> sb(b, b + m + 1);
+            sa[m] = add_to(sa.data(), m, a + m, an - m);
+            sb[m] = add_to(sb.data(), m, b + m, bn - m);
+            std::vector<uint32_t> mid(2 * m + 2, 0);
+            fork_join(threads,
+                [&](unsigned t) { multiply(a, m, b, m, r, t); },
+                [&](unsigned t) { multiply(a + m, an - m, b + m, bn - m, r + 2 * m, t); },
+                [&](unsigned t) { multiply(sa.data(), trimmed(sa.data(), m + 1), sb.data(), trimmed(sb.data(), m + 1), mid.data(), t); });
+            sub_from(mid.data(), mid.size(), r, 2 * m);
+            sub_from(mid.data(), mid.size(), r + 2 * m, an + bn - 2 * m);
+            add_to(r + m, an + bn - m, mid.data(), trimmed(mid.data(), mid.size()));
+        }
+    }
+
+    // Number of threads used by the multiplication of large numbers.
+    inline void set_multiplication_threads(unsigned threads) {
+        detail::multiplication_threads() = std::max(1u, threads);
+    }
+
+    inline unsigned multiplication_threads() {
+        return detail::multiplication_threads();
+    }
+
     ///////////////// BIGNUM CLASS
 
     struct bignum {
         public:
             bignum();
-            bignum(uint32_t n);
-            explicit bignum(std::string const& src);
+            bignum(uint32_t n, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+            explicit bignum(std::string const& src, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
             bignum(bignum const& other);
-            bignum& operator=(bignum other);
+            bignum(bignum const& other, std::pmr::memory_resource* resource);
+            bignum(bignum&& other) noexcept;
+            bignum& operator=(bignum const& other);
+            bignum& operator=(bignum&& other);
             explicit operator uint32_t() const;
             explicit operator bool() const;
             std::string to_string() const;
 
+            // Hexadecimal digits without prefix, linear in the number of limbs.
+            std::string to_hex(bool uppercase = false) const;
+            static bignum from_hex(std::string_view src,
+                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+            // Raw little-endian limbs: byte_size() bytes, four per limb.
+            size_t byte_size() const;
+            void to_bytes(unsigned char* dst) const;
+            static bignum from_bytes(unsigned char const* src, size_t size,
+                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+            // Limb count as a little-endian uint64_t followed by the raw limbs.
+            void write(std::ostream& os) const;
+            static bignum read(std::istream& is,
+                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
             bignum& operator+=(bignum const& other);
             bignum& operator-=(bignum const& other) = delete;
             bignum& operator*=(bignum const& other);
 
             void swap(bignum& rhs);
 
+            friend bool operator==(bignum const& lhs, bignum const& rhs);
+
+            std::pmr::memory_resource* resource() const;
+
         private:
-            std::vector<uint32_t> bits_;
+            std::pmr::vector<uint32_t> bits_;
             static const uint64_t BASE = static_cast<uint64_t>(UINT32_MAX) + 1;
     };
 
+    inline bool operator!=(bignum const& lhs, bignum const& rhs);
+
     inline std::ostream& operator<<(std::ostream& os, bignum const& n);
     inline std::istream& operator>>(std::istream& is, bignum& n);
 
-    inline bignum operator+(bignum lhs, bignum const& rhs);
-    inline bignum operator*(bignum lhs, bignum const& rhs);
+    inline bignum operator+(bignum const& lhs, bignum const& rhs);
+    inline bignum operator+(bignum&& lhs, bignum const& rhs);
+    inline bignum operator*(bignum const& lhs, bignum const& rhs);
+    inline bignum operator*(bignum&& lhs, bignum const& rhs);
 
     inline bignum::bignum() : bits_(1, 0) {}
 
-    inline bignum::bignum(uint32_t n) : bits_(1, n) {}
+    inline bignum::bignum(uint32_t n, std::pmr::memory_resource* resource) : bits_(1, n, resource) {}
 
-    inline bignum::bignum(std::string const& src) : bignum() {
-        for (auto c : src) {
-            (*this) = (*this) * 10 + (c - '0');
+    // Nine digits at a time are folded into the limbs in place, so an arena
+    // only sees the geometric growth of one buffer.
+    inline bignum::bignum(std::string const& src, std::pmr::memory_resource* resource) : bignum(0, resource) {
+        for (size_t pos = 0; pos < src.size(); ) {
+            size_t const count = std::min<size_t>(9, src.size() - pos);
+            uint32_t digits = 0;
+            uint32_t scale = 1;
+            for (size_t i = 0; i < count; ++i, ++pos) {
+                digits = digits * 10 + static_cast<uint32_t>(src[pos] - '0');
+                scale *= 10;
+            }
+            uint64_t carry = digits;
+            for (auto& limb : bits_) {
+                carry += static_cast<uint64_t>(limb) * scale;
+                limb = static_cast<uint32_t>(carry);
+                carry >>= 32;
+            }
+            if (carry != 0) {
+                bits_.push_back(static_cast<uint32_t>(carry));
+            }
         }
     }
 
-    inline bignum::bignum(bignum const& other) : bits_(other.bits_) {}
+    // Like std::pmr containers, a copy uses the default resource and a move
+    // keeps the resource of the source. Results of arithmetic use the memory
+    // resource of the left operand, so a computation started in an arena
+    // stays in it.
+    inline bignum::bignum(bignum const& other) : bits_(other.bits_, std::pmr::get_default_resource()) {}
 
-    inline bignum& bignum::operator=(bignum other) {
-        swap(other);
+    inline bignum::bignum(bignum const& other, std::pmr::memory_resource* resource)
+        : bits_(other.bits_, resource) {}
+
+    inline bignum::bignum(bignum&& other) noexcept : bits_(std::move(other.bits_)) {}
+
+    // Assignment never changes the memory resource of the target.
+    inline bignum& bignum::operator=(bignum const& other) {
+        bits_ = other.bits_;
+        return *this;
+    }
+
+    inline bignum& bignum::operator=(bignum&& other) {
+        bits_ = std::move(other.bits_);
         return *this;
     }
 
@@ -70,7 +298,7 @@ namespace mp {
             return "0";
         }
         std::string result;
-        bignum copied(*this);
+        bignum copied(*this, resource());
         while (static_cast<unsigned>(std::count(copied.bits_.begin(), copied.bits_.end(), 0)) != copied.bits_.size()) {
             uint32_t d = 0;
             uint32_t r = 0;
@@ -105,78 +333,379 @@ namespace mp {
     }
 
     inline bignum& bignum::operator*=(bignum const& other) {
-        bignum result;
-        result.bits_.resize(bits_.size() + other.bits_.size());
-        for (size_t i = 0; i < bits_.size(); ++i) {
-            uint32_t carry = 0;
-            for (size_t j = 0; j < other.bits_.size() || carry != 0; ++j) {
-                uint64_t cur = result.bits_[i + j] 
-                    + static_cast<uint64_t>(bits_[i]) * (j < other.bits_.size() ? other.bits_[j] : 0) 
-                    + carry;
-                result.bits_[i + j] = static_cast<uint32_t>(cur % BASE);
-                carry = static_cast<uint32_t>(cur / BASE);
+        std::pmr::vector<uint32_t> result(bits_.size() + other.bits_.size(), 0, bits_.get_allocator());
+        detail::multiply(bits_.data(), bits_.size(), other.bits_.data(), other.bits_.size(),
+            result.data(), multiplication_threads());
+        while (result.size() > 1 && result.back() == 0) {
+            result.pop_back();
+        }
+        bits_ = std::move(result);
+        return *this;
+    }
+
+    inline void bignum::swap(bignum& rhs) {
+        if (bits_.get_allocator() == rhs.bits_.get_allocator()) {
+            bits_.swap(rhs.bits_);
+        } else {
+            bignum tmp(std::move(*this), rhs.resource());
+            *this = std::move(rhs);
+            rhs = std::move(tmp);
+        }
+    }
+
+    inline std::pmr::memory_resource* bignum::resource() const {
+        return bits_.get_allocator().resource();
+    }
+
+    inline std::string bignum::to_hex(bool uppercase) const {
+        char const* digits = (uppercase ? "0123456789ABCDEF" : "0123456789abcdef");
+        uint32_t top = bits_.back();
+        size_t top_digits = 1;
+        while (top_digits < 8 && (top >> (4 * top_digits)) != 0) {
+            ++top_digits;
+        }
+
+        std::string result(top_digits + 8 * (bits_.size() - 1), '0');
+        auto out = result.begin();
+        for (size_t i = top_digits; i > 0; --i) {
+            *out++ = digits[(top >> (4 * (i - 1))) & 0xf];
+        }
+        for (size_t limb = bits_.size() - 1; limb > 0; --limb) {
+            uint32_t cur = bits_[limb - 1];
+            for (size_t i = 8; i > 0; --i) {
+                *out++ = digits[(cur >> (4 * (i - 1))) & 0xf];
             }
         }
-        while (result.bits_.size() > 1 && result.bits_.back() == 0) {
-            result.bits_.pop_back();
+        return result;
+    }
+
+    inline bignum bignum::from_hex(std::string_view src, std::pmr::memory_resource* resource) {
+        if (src.size() >= 2 && src[0] == '0' && (src[1] == 'x' || src[1] == 'X')) {
+            src.remove_prefix(2);
+        }
+        if (src.empty()) {
+            throw std::invalid_argument("bignum: empty hexadecimal string");
         }
-        return (*this = result);
+
+        bignum result(0, resource);
+        result.bits_.assign((src.size() + 7) / 8, 0);
+        for (size_t i = 0; i < src.size(); ++i) {
+            int value = detail::hex_value(src[src.size() - 1 - i]);
+            if (value < 0) {
+                throw std::invalid_argument("bignum: invalid hexadecimal digit");
+            }
+            result.bits_[i / 8] |= static_cast<uint32_t>(value) << (4 * (i % 8));
+        }
+        result.bits_.resize(std::max<size_t>(1, detail::trimmed(result.bits_.data(), result.bits_.size())));
+        return result;
     }
 
-    inline void bignum::swap(bignum& rhs) {
-        std::swap(bits_, rhs.bits_);
+    inline size_t bignum::byte_size() const {
+        return bits_.size() * sizeof(uint32_t);
+    }
+
+    inline void bignum::to_bytes(unsigned char* dst) const {
+        if (detail::little_endian()) {
+            std::memcpy(dst, bits_.data(), byte_size());
+            return;
+        }
+        for (uint32_t limb : bits_) {
+            for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+                *dst++ = static_cast<unsigned char>(limb >> (8 * i));
+            }
+        }
+    }
+
+    inline bignum bignum::from_bytes(unsigned char const* src, size_t size, std::pmr::memory_resource* resource) {
+        bignum result(0, resource);
+        result.bits_.assign(std::max<size_t>(1, (size + sizeof(uint32_t) - 1) / sizeof(uint32_t)), 0);
+        if (size == 0) {
+            return result;
+        }
+        if (detail::little_endian()) {
+            std::memcpy(result.bits_.data(), src, size);
+        } else {
+            for (size_t i = 0; i < size; ++i) {
+                result.bits_[i / sizeof(uint32_t)] |= static_cast<uint32_t>(src[i]) << (8 * (i % sizeof(uint32_t)));
+            }
+        }
+        result.bits_.resize(std::max<size_t>(1, detail::trimmed(result.bits_.data(), result.bits_.size())));
+        return result;
+    }
+
+    inline void bignum::write(std::ostream& os) const {
+        unsigned char header[sizeof(uint64_t)];
+        uint64_t limbs = bits_.size();
+        for (size_t i = 0; i < sizeof(header); ++i) {
+            header[i] = static_cast<unsigned char>(limbs >> (8 * i));
+        }
+        os.write(reinterpret_cast<char const*>(header), sizeof(header));
+        if (detail::little_endian()) {
+            os.write(reinterpret_cast<char const*>(bits_.data()), byte_size());
+        } else {
+            std::vector<unsigned char> bytes(byte_size());
+            to_bytes(bytes.data());
+            os.write(reinterpret_cast<char const*>(bytes.data()), bytes.size());
+        }
+    }
+
+    inline bignum bignum::read(std::istream& is, std::pmr::memory_resource* resource) {
+        bignum result(0, resource);
+        unsigned char header[sizeof(uint64_t)];
+        if (!is.read(reinterpret_cast<char*>(header), sizeof(header))) {
+            return result;
+        }
+        uint64_t limbs = 0;
+        for (size_t i = 0; i < sizeof(header); ++i) {
+            limbs |= static_cast<uint64_t>(header[i]) << (8 * i);
+        }
+        if (limbs == 0) {
+            is.setstate(std::ios::failbit);
+            return result;
+        }
+
+        // The limb count comes from the input, so storage grows in bounded
+        // chunks as the limbs actually arrive.
+        result.bits_.clear();
+        for (uint64_t done = 0; done < limbs; ) {
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(limbs - done, detail::READ_CHUNK));
+            result.bits_.resize(result.bits_.size() + chunk);
+            if (!is.read(reinterpret_cast<char*>(result.bits_.data() + done), chunk * sizeof(uint32_t))) {
+                return bignum(0, resource);
+            }
+            done += chunk;
+        }
+        if (!detail::little_endian()) {
+            bignum swapped = from_bytes(reinterpret_cast<unsigned char const*>(result.bits_.data()),
+                result.byte_size(), resource);
+            result.swap(swapped);
+        }
+        result.bits_.resize(std::max<size_t>(1, detail::trimmed(result.bits_.data(), result.bits_.size())));
+        return result;
+    }
+
+    inline bool operator==(bignum const& lhs, bignum const& rhs) {
+        return std::equal(lhs.bits_.begin(), lhs.bits_.end(), rhs.bits_.begin(), rhs.bits_.end());
+    }
+
+    inline bool operator!=(bignum const& lhs, bignum const& rhs) {
+        return !(lhs == rhs);
     }
 
     std::ostream& operator<<(std::ostream& os, bignum const& n) {
+        if ((os.flags() & std::ios::basefield) == std::ios::hex) {
+            return os << n.to_hex((os.flags() & std::ios::uppercase) != 0);
+        }
         return os << n.to_string();
     }
 
     std::istream& operator>>(std::istream& is, bignum& n) {
         std::string src;
         is >> src;
+        if ((is.flags() & std::ios::basefield) == std::ios::hex) {
+            try {
+                n = bignum::from_hex(src);
+            } catch (std::invalid_argument const&) {
+                is.setstate(std::ios::failbit);
+            }
+            return is;
+        }
         n = bignum(src);
         return is;
     }
 
-    bignum operator+(bignum lhs, bignum const& rhs) {
-        return lhs += rhs;
+    bignum operator+(bignum const& lhs, bignum const& rhs) {
+        bignum result(lhs, lhs.resource());
+        result += rhs;
+        return result;
     }
 
-    bignum operator*(bignum lhs, bignum const& rhs) {
-        return lhs *= rhs;
+    bignum operator+(bignum&& lhs, bignum const& rhs) {
+        lhs += rhs;
+        return std::move(lhs);
+    }
+
+    bignum operator*(bignum const& lhs, bignum const& rhs) {
+        bignum result(lhs, lhs.resource());
+        result *= rhs;
+        return result;
+    }
+
+    bignum operator*(bignum&& lhs, bignum const& rhs) {
+        lhs *= rhs;
+        return std::move(lhs);
     }
 
     ///////////////// POLYNOMIAL CLASS
 
+    namespace detail {
+        size_t const NTT_THRESHOLD = 2048;
+        size_t const NTT_MAX_SIZE = size_t(1) << 23;
+        uint32_t const NTT_PRIMES[3] = {998244353, 167772161, 469762049};
+        uint32_t const NTT_ROOT = 3;
+
+        inline uint32_t pow_mod(uint64_t base, uint64_t exp, uint32_t mod) {
+            uint64_t result = 1;
+            base %= mod;
+            for (; exp > 0; exp >>= 1) {
+                if (exp & 1) {
+                    result = result * base % mod;
+                }
+                base = base * base % mod;
+            }
+            return static_cast<uint32_t>(result);
+        }
+
+        inline void ntt(std::vector<uint32_t>& a, bool invert, uint32_t mod) {
+            size_t const n = a.size();
+            for (size_t i = 1, j = 0; i < n; ++i) {
+                size_t bit = n >> 1;
+                for (; j & bit; bit >>= 1) {
+                    j ^= bit;
+                }
+                j ^= bit;
+                if (i < j) {
+                    std::swap(a[i], a[j]);
+                }
+            }
+            for (size_t len = 2; len <= n; len <<= 1) {
+                uint64_t w = pow_mod(NTT_ROOT, (mod - 1) / len, mod);
+                if (invert) {
+                    w = pow_mod(w, mod - 2, mod);
+                }
+                for (size_t i = 0; i < n; i += len) {
+                    uint64_t wn = 1;
+                    for (size_t j = 0; j < len / 2; ++j) {
+                        uint32_t u = a[i + j];
+                        uint32_t v = static_cast<uint32_t>(a[i + j + len / 2] * wn % mod);
+                        a[i + j] = (u + v >= mod ? u + v - mod : u + v);
+                        a[i + j + len / 2] = (u >= v ? u - v : u + mod - v);
+                        wn = wn * w % mod;
+                    }
+                }
+            }
+            if (invert) {
+                uint64_t n_inv = pow_mod(n, mod - 2, mod);
+                for (auto& x : a) {
+                    x = static_cast<uint32_t>(x * n_inv % mod);
+                }
+            }
+        }
+
+        inline std::vector<uint32_t> convolution_mod(std::vector<uint32_t> const& a, std::vector<uint32_t> const& b,
+                size_t n, uint32_t mod) {
+            std::vector<uint32_t> fa(n, 0);
+            std::vector<uint32_t> fb(n, 0);
+            for (size_t i = 0; i < a.size(); ++i) {
+                fa[i] = a[i] % mod;
+            }
+            for (size_t i = 0; i < b.size(); ++i) {
+                fb[i] = b[i] % mod;
+            }
+            ntt(fa, false, mod);
+            ntt(fb, false, mod);
+            for (size_t i = 0; i < n; ++i) {
+                fa[i] = static_cast<uint32_t>(static_cast<uint64_t>(fa[i]) * fb[i] % mod);
+            }
+            ntt(fa, true, mod);
+            return fa;
+        }
+
+        // Exact convolution of a and b reduced modulo 2^32: three NTT primes
+        // cover sums of up to 2^22 products of 32-bit values, combined by Garner.
+        inline std::vector<uint32_t> convolution(std::vector<uint32_t> const& a, std::vector<uint32_t> const& b) {
+            size_t const result_size = a.size() + b.size() - 1;
+            size_t n = 1;
+            while (n < result_size) {
+                n <<= 1;
+            }
+            if (n > NTT_MAX_SIZE) {
+                throw std::length_error("polynomial: product is too large");
+            }
+
+            uint32_t const p0 = NTT_PRIMES[0];
+            uint32_t const p1 = NTT_PRIMES[1];
+            uint32_t const p2 = NTT_PRIMES[2];
+            std::vector<uint32_t> r0 = convolution_mod(a, b, n, p0);
+            std::vector<uint32_t> r1 = convolution_mod(a, b, n, p1);
+            std::vector<uint32_t> r2 = convolution_mod(a, b, n, p2);
+
+            uint64_t const p0_inv = pow_mod(p0, p1 - 2, p1);
+            uint64_t const p01_inv = pow_mod(static_cast<uint64_t>(p0) * p1 % p2, p2 - 2, p2);
+            uint64_t const p01 = static_cast<uint64_t>(p0) * p1;
+
+            std::vector<uint32_t> result(result_size);
+            for (size_t i = 0; i < result_size; ++i) {
+                uint64_t t1 = (r1[i] + p1 - r0[i] % p1) % p1 * p0_inv % p1;
+                uint64_t x01 = r0[i] + p0 * t1;
+                uint64_t t2 = (r2[i] + p2 - x01 % p2) % p2 * p01_inv % p2;
+                result[i] = static_cast<uint32_t>(x01 + p01 * t2);
+            }
+            return result;
+        }
+    }
+
+    // Coefficients are taken modulo 2^32, like uint32_t arithmetic.
     struct polynomial {
         public:
-            explicit polynomial(std::string const& src);
+            polynomial();
+            explicit polynomial(std::string_view src);
             uint32_t at(size_t idx) const;
             uint32_t& at(size_t idx);
+            size_t size() const;
             template<typename T> T operator()(T const& point) const;
-        
+
+            polynomial& operator+=(polynomial const& other);
+            polynomial& operator*=(polynomial const& other);
+
         private:
+            void normalize();
+
             std::vector<uint32_t> coeffs_;
     };
 
-    inline polynomial::polynomial(std::string const& src) {
-        std::vector<std::string> tokens;
-        size_t pos_start = 0;
-        size_t pos_end = 0;
-        while ((pos_end = src.find_first_of("^+", pos_start)) != std::string::npos) {
-            std::string token = src.substr(pos_start, pos_end - pos_start);
-            pos_start = ++pos_end;
-            tokens.push_back(token);
-        }
-        tokens.push_back(src.substr(pos_start));
+    inline bool operator==(polynomial const& lhs, polynomial const& rhs);
+    inline bool operator!=(polynomial const& lhs, polynomial const& rhs);
+
+    inline polynomial operator+(polynomial lhs, polynomial const& rhs);
+    inline polynomial operator*(polynomial lhs, polynomial const& rhs);
 
-        uint32_t max_pow = std::strtoul(tokens[1].c_str(), nullptr, 10);
-        coeffs_.resize(max_pow + 1, 0);
+    inline polynomial::polynomial() : coeffs_(1, 0) {}
 
-        for (size_t i = 0; i < tokens.size(); i += 2) {
-            uint32_t coeff = std::strtoul(tokens[i].c_str(), nullptr, 10);
-            uint32_t pow = std::strtoul(tokens[i + 1].c_str(), nullptr, 10);
-            coeffs_[pow] = coeff;
+    // Terms "coeff^pow" joined by '+', in any order. Coefficients are taken
+    // modulo 2^32, powers that do not fit into uint32_t are rejected.
+    inline polynomial::polynomial(std::string_view src) {
+        size_t pos = 0;
+        auto read_number = [&src, &pos](bool exact) {
+            if (pos == src.size() || src[pos] < '0' || src[pos] > '9') {
+                throw std::invalid_argument("polynomial: expected a number");
+            }
+            uint32_t value = 0;
+            for (; pos < src.size() && src[pos] >= '0' && src[pos] <= '9'; ++pos) {
+                uint32_t const digit = static_cast<uint32_t>(src[pos] - '0');
+                if (exact && value > (UINT32_MAX - digit) / 10) {
+                    throw std::invalid_argument("polynomial: power is too large");
+                }
+                value = value * 10 + digit;
+            }
+            return value;
+        };
+
+        while (true) {
+            uint32_t coeff = read_number(false);
+            if (pos == src.size() || src[pos] != '^') {
+                throw std::invalid_argument("polynomial: expected '^'");
+            }
+            ++pos;
+            uint32_t pow = read_number(true);
+            at(pow) = coeff;
+            if (pos == src.size()) {
+                break;
+            }
+            if (src[pos] != '+') {
+                throw std::invalid_argument("polynomial: expected '+'");
+            }
+            ++pos;
         }
     }
 
@@ -191,6 +720,64 @@ namespace mp {
         return coeffs_[idx];
     }
 
+    inline size_t polynomial::size() const {
+        return coeffs_.size();
+    }
+
+    inline polynomial& polynomial::operator+=(polynomial const& other) {
+        if (other.coeffs_.size() > coeffs_.size()) {
+            coeffs_.resize(other.coeffs_.size(), 0);
+        }
+        for (size_t i = 0; i < other.coeffs_.size(); ++i) {
+            coeffs_[i] += other.coeffs_[i];
+        }
+        normalize();
+        return *this;
+    }
+
+    inline polynomial& polynomial::operator*=(polynomial const& other) {
+        if (std::min(coeffs_.size(), other.coeffs_.size()) < detail::NTT_THRESHOLD) {
+            std::vector<uint32_t> result(coeffs_.size() + other.coeffs_.size() - 1, 0);
+            for (size_t i = 0; i < coeffs_.size(); ++i) {
+                for (size_t j = 0; j < other.coeffs_.size(); ++j) {
+                    result[i + j] += coeffs_[i] * other.coeffs_[j];
+                }
+            }
+            coeffs_ = std::move(result);
+        } else {
+            coeffs_ = detail::convolution(coeffs_, other.coeffs_);
+        }
+        normalize();
+        return *this;
+    }
+
+    inline void polynomial::normalize() {
+        while (coeffs_.size() > 1 && coeffs_.back() == 0) {
+            coeffs_.pop_back();
+        }
+    }
+
+    inline bool operator==(polynomial const& lhs, polynomial const& rhs) {
+        for (size_t i = 0; i < std::max(lhs.size(), rhs.size()); ++i) {
+            if (lhs.at(i) != rhs.at(i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    inline bool operator!=(polynomial const& lhs, polynomial const& rhs) {
+        return !(lhs == rhs);
+    }
+
+    inline polynomial operator+(polynomial lhs, polynomial const& rhs) {
+        return lhs += rhs;
+    }
+
+    inline polynomial operator*(polynomial lhs, polynomial const& rhs) {
+        return lhs *= rhs;
+    }
+
     template<typename T> T polynomial::operator()(T const& point) const {
         T result = coeffs_[coeffs_.size() - 1];
         for (size_t i = coeffs_.size() - 1; i > 0; --i) {
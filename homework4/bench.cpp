@@ -0,0 +1,414 @@
+#include "concurrent_dict.hpp"
+#include "dict_binary.hpp"
+#include "dict_json.hpp"
+#include "dict_lazy_json.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Benchmarks for the dict. Every measured result is cross-checked first:
+// flat_map against std::unordered_map, JSON loading and the streaming JSON
+// writer against nlohmann::json, the binary format by loading it back, the
+// lazy loader against load_from_json and key paths against chained get.
+//
+// Then the read scalability of utils::concurrent_dict by thread count, with
+// and without a writer updating the dict at the same time. One shard is the
+// baseline of a single reader/writer lock around the whole dict.
+
+namespace {
+    double const SECONDS = 0.3;
+    double const MIN_SECONDS = 0.2;
+
+    std::atomic<bool> failed(false);
+    bool mismatch = false;
+    size_t sink = 0;
+
+    void print_error(std::string const& program_name, std::string const& message) {
+        std::string usage = "\nUsage: " + program_name + " [max threads] [keys]";
+        std::cout << message << usage << std::endl;
+    }
+
+    std::string key_name(size_t id) {
+        return "key" + std::to_string(id);
+    }
+
+    // Every value equals its key index, so readers can verify what they see
+    // while the writer keeps overwriting and re-inserting entries.
+    void reader(utils::concurrent_dict const& dict, std::vector<std::string> const& keys,
+            unsigned seed, std::atomic<bool> const& stop, size_t& reads) {
+        std::mt19937 rng(seed);
+        size_t count = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            for (int i = 0; i < 256; ++i) {
+                size_t id = rng() % keys.size();
+                if (auto value = dict.get_ptr<int>(keys[id])) {
+                    if (*value != static_cast<int>(id)) {
+                        failed = true;
+                    }
+                }
+            }
+            count += 256;
+        }
+        reads = count;
+    }
+
+    void writer(utils::concurrent_dict& dict, std::vector<std::string> const& keys, std::atomic<bool> const& stop) {
+        std::mt19937 rng(7);
+        while (!stop.load(std::memory_order_relaxed)) {
+            size_t id = rng() % keys.size();
+            if (rng() % 8 == 0) {
+                dict.remove(keys[id]);
+            } else {
+                dict.set(keys[id], static_cast<int>(id));
+            }
+        }
+    }
+
+    void check(bool ok, std::string const& what) {
+        if (!ok) {
+            std::cout << "MISMATCH: " << what << std::endl;
+            mismatch = true;
+        }
+    }
+
+    // Runs op until MIN_SECONDS elapsed and reports the time per operation
+    // and per item it handles.
+    template<typename Op>
+    void measure(std::string const& name, size_t items, Op op) {
+        using clock = std::chrono::steady_clock;
+        size_t iterations = 0;
+        auto start = clock::now();
+        double elapsed = 0;
+        do {
+            op();
+            ++iterations;
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        } while (elapsed < MIN_SECONDS);
+
+        double ns_per_op = elapsed * 1e9 / iterations;
+        std::cout << std::left << std::setw(20) << name
+            << std::right << std::setw(10) << items
+            << std::setw(16) << std::fixed << std::setprecision(1) << ns_per_op
+            << std::setw(16) << ns_per_op / items
+            << std::defaultfloat << std::endl;
+    }
+
+    // Random inserts, erases and lookups must leave flat_map with the same
+    // entries as std::unordered_map.
+    void bench_flat_map(std::vector<std::string> const& keys) {
+        std::mt19937 rng(42);
+        utils::flat_map<int> map;
+        std::unordered_map<std::string, int> reference;
+        for (size_t i = 0; i < 8 * keys.size(); ++i) {
+            std::string const& key = keys[rng() % keys.size()];
+            int const value = static_cast<int>(rng());
+            switch (rng() % 3) {
+                case 0:
+                    check(map.try_emplace(key, value).second == reference.emplace(key, value).second,
+                        "flat_map insert");
+                    break;
+                case 1:
+                    check(map.erase(key) == reference.erase(key), "flat_map erase");
+                    break;
+                default: {
+                    auto it = map.find(key);
+                    auto expected = reference.find(key);
+                    check((it == map.end()) == (expected == reference.end())
+                        && (it == map.end() || it->second == expected->second), "flat_map find");
+                }
+            }
+        }
+        check(map.size() == reference.size(), "flat_map size");
+        for (auto const& [key, value] : map) {
+            auto it = reference.find(std::string(key));
+            check(it != reference.end() && it->second == value, "flat_map iteration");
+        }
+
+        measure("flat_map insert", keys.size(), [&] {
+            utils::flat_map<int> tmp;
+            for (size_t id = 0; id < keys.size(); ++id) {
+                tmp.try_emplace(keys[id], static_cast<int>(id));
+            }
+            sink += tmp.size();
+        });
+        measure("unordered_map insert", keys.size(), [&] {
+            std::unordered_map<std::string, int> tmp;
+            for (size_t id = 0; id < keys.size(); ++id) {
+                tmp.emplace(keys[id], static_cast<int>(id));
+            }
+            sink += tmp.size();
+        });
+
+        map.clear();
+        reference.clear();
+        for (size_t id = 0; id < keys.size(); ++id) {
+            map.try_emplace(keys[id], static_cast<int>(id));
+            reference.emplace(keys[id], static_cast<int>(id));
+        }
+        measure("flat_map find", keys.size(), [&] {
+            for (auto const& key : keys) {
+                sink += map.find(key)->second;
+            }
+        });
+        measure("unordered_map find", keys.size(), [&] {
+            for (auto const& key : keys) {
+                sink += reference.find(key)->second;
+            }
+        });
+    }
+
+    // One nested object per item, about 110 bytes each.
+    std::string document_text(size_t objects) {
+        std::string text = "{";
+        for (size_t i = 0; i < objects; ++i) {
+            std::string id = std::to_string(i);
+            text += (i == 0 ? "\"k" : ",\"k") + id + "\":{\"name\":\"item number " + id
+                + "\",\"vals\":[1,2,3,4,5,6,7,8],\"sub\":{\"a\":1.5,\"b\":true,\"c\":\"xyzxyzxyzxyzxyzxyzxyz\"}}";
+        }
+        return text + "}";
+    }
+
+    void bench_json(std::string const& text, utils::dict_t const& dict, size_t objects) {
+        json const expected = json::parse(text);
+        check(json_from_dict(dict) == expected, "load_from_json");
+        std::stringstream output;
+        utils::save_to_json(output, dict);
+        check(json::parse(output.str()) == expected, "save_to_json");
+
+        measure("json load", objects, [&] {
+            utils::dict_t tmp;
+            std::stringstream input(text);
+            utils::load_from_json(input, tmp);
+            sink += tmp.size();
+        });
+        measure("json save", objects, [&] {
+            std::stringstream tmp;
+            utils::save_to_json(tmp, dict);
+            sink += tmp.str().size();
+        });
+        measure("nlohmann dump", objects, [&] {
+            sink += json_from_dict(dict).dump().size();
+        });
+    }
+
+    void bench_binary(utils::dict_t const& dict, size_t objects) {
+        std::stringstream output;
+        utils::save_to_binary(output, dict);
+        std::string const buffer = output.str();
+        utils::dict_t loaded;
+        std::stringstream input(buffer);
+        check(utils::load_from_binary(input, loaded) && loaded == dict, "binary round trip");
+        utils::binary_view view(buffer.data(), buffer.size());
+        for (auto const& [key, value] : dict) {
+            auto found = view.root().find(key);
+            check(found && found->as_dict().find("name")->as_string()
+                == utils::get<std::string>(utils::get<utils::dict_t>(dict, key), "name"), "binary_view find");
+        }
+
+        measure("binary save", objects, [&] {
+            std::stringstream tmp;
+            utils::save_to_binary(tmp, dict);
+            sink += tmp.str().size();
+        });
+        measure("binary load", objects, [&] {
+            utils::dict_t tmp;
+            std::stringstream tmp_input(buffer);
+            utils::load_from_binary(tmp_input, tmp);
+            sink += tmp.size();
+        });
+        measure("binary_view find", objects, [&] {
+            utils::binary_dict root = view.root();
+            for (auto const& [key, value] : dict) {
+                sink += root.find(key)->as_dict().size();
+            }
+        });
+    }
+
+    // Loading and then reading one nested key, the case lazy loading is for.
+    void bench_lazy(std::string const& text, utils::dict_t const& eager, size_t objects) {
+        utils::dict_t lazy;
+        std::stringstream input(text);
+        check(utils::load_from_json_lazy(input, lazy), "load_from_json_lazy");
+        check(json_from_dict(lazy) == json_from_dict(eager), "lazy against eager");
+
+        std::string const key = "k" + std::to_string(objects / 2);
+        auto load_and_get = [&key](auto load, std::string const& src) {
+            utils::dict_t tmp;
+            std::stringstream tmp_input(src);
+            load(tmp_input, tmp);
+            utils::dict_t const& loaded = tmp;
+            return utils::get<double>(utils::get<utils::dict_t>(utils::get<utils::dict_t>(loaded, key), "sub"), "a");
+        };
+        auto eager_load = [](std::istream& is, utils::dict_t& dict) {
+            return utils::load_from_json(is, dict);
+        };
+        auto lazy_load = [](std::istream& is, utils::dict_t& dict) {
+            return utils::load_from_json_lazy(is, dict);
+        };
+        check(load_and_get(lazy_load, text) == load_and_get(eager_load, text), "lazy get");
+
+        measure("json load + get", objects, [&] {
+            sink += static_cast<size_t>(load_and_get(eager_load, text));
+        });
+        measure("lazy load + get", objects, [&] {
+            sink += static_cast<size_t>(load_and_get(lazy_load, text));
+        });
+    }
+
+    // A config of 50 sections with 50 subsections of 50 values each, read
+    // three levels down by random paths.
+    void bench_key_path() {
+        size_t const WIDTH = 50;
+        size_t const PATHS = 256;
+        auto name = [](char const* prefix, size_t id) {
+            return prefix + std::to_string(id);
+        };
+        utils::dict_t config;
+        for (size_t i = 0; i < WIDTH; ++i) {
+            utils::dict_t section;
+            for (size_t j = 0; j < WIDTH; ++j) {
+                utils::dict_t subsection;
+                for (size_t k = 0; k < WIDTH; ++k) {
+                    utils::put(subsection, name("configuration_value_", k), static_cast<int>(k + WIDTH * (j + WIDTH * i)));
+                }
+                utils::put(section, name("subsection_name_", j), std::move(subsection));
+            }
+            utils::put(config, name("section_number_", i), std::move(section));
+        }
+
+        std::mt19937 rng(42);
+        std::vector<std::vector<std::string>> keys;
+        std::vector<std::string> texts;
+        std::vector<utils::key_path> paths;
+        for (size_t i = 0; i < PATHS; ++i) {
+            keys.push_back({name("section_number_", rng() % WIDTH), name("subsection_name_", rng() % WIDTH),
+                name("configuration_value_", rng() % WIDTH)});
+            texts.push_back(keys.back()[0] + "." + keys.back()[1] + "." + keys.back()[2]);
+            paths.push_back(utils::key_path(texts.back()));
+        }
+
+        utils::dict_t const& dict = config;
+        auto chained = [&dict](std::vector<std::string> const& path) {
+            return utils::get<int>(utils::get<utils::dict_t>(utils::get<utils::dict_t>(dict, path[0]), path[1]), path[2]);
+        };
+        for (size_t i = 0; i < PATHS; ++i) {
+            check(utils::get_path<int>(dict, paths[i]) == chained(keys[i]), "get_path");
+            check(utils::get_path<int>(dict, utils::key_path::of_keys({keys[i][0], keys[i][1], keys[i][2]}))
+                == chained(keys[i]), "key_path::of_keys");
+        }
+
+        measure("get chain", PATHS, [&] {
+            for (auto const& path : keys) {
+                sink += chained(path);
+            }
+        });
+        measure("get_path", PATHS, [&] {
+            for (auto const& path : paths) {
+                sink += utils::get_path<int>(dict, path);
+            }
+        });
+        measure("key_path + get_path", PATHS, [&] {
+            for (auto const& text : texts) {
+                sink += utils::get_path<int>(dict, utils::key_path(text));
+            }
+        });
+    }
+
+    void measure(size_t shards, unsigned threads, bool with_writer, std::vector<std::string> const& keys) {
+        utils::concurrent_dict dict(shards);
+        for (size_t id = 0; id < keys.size(); ++id) {
+            dict.put(keys[id], static_cast<int>(id));
+        }
+
+        std::atomic<bool> stop(false);
+        std::vector<size_t> reads(threads, 0);
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < threads; ++i) {
+            workers.emplace_back(reader, std::cref(dict), std::cref(keys), i + 1, std::cref(stop), std::ref(reads[i]));
+        }
+        if (with_writer) {
+            workers.emplace_back(writer, std::ref(dict), std::cref(keys), std::cref(stop));
+        }
+        auto start = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::duration<double>(SECONDS));
+        stop = true;
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        size_t total = 0;
+        for (size_t count : reads) {
+            total += count;
+        }
+        std::cout << std::setw(8) << dict.shard_count()
+            << std::setw(10) << threads
+            << std::setw(10) << (with_writer ? "yes" : "no")
+            << std::setw(16) << std::scientific << std::setprecision(3) << total / elapsed
+            << std::setw(16) << total / elapsed / threads
+            << std::defaultfloat << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 3) {
+        print_error(argv[0], "Wrong number of arguments!");
+        return 0;
+    }
+    unsigned max_threads = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : std::thread::hardware_concurrency());
+    size_t key_count = (argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000);
+    if (max_threads == 0 || key_count == 0) {
+        print_error(argv[0], "Invalid arguments!");
+        return 0;
+    }
+
+    std::vector<std::string> keys;
+    for (size_t id = 0; id < key_count; ++id) {
+        keys.push_back(key_name(id));
+    }
+
+    std::cout << std::left << std::setw(20) << "operation"
+        << std::right << std::setw(10) << "items"
+        << std::setw(16) << "ns/op"
+        << std::setw(16) << "ns/item" << std::endl;
+
+    bench_flat_map(keys);
+
+    size_t const objects = std::max<size_t>(1, key_count / 5);
+    std::string const text = document_text(objects);
+    utils::dict_t document;
+    std::stringstream input(text);
+    check(utils::load_from_json(input, document), "load_from_json");
+    bench_json(text, document, objects);
+    bench_binary(document, objects);
+    bench_lazy(text, document, objects);
+    bench_key_path();
+
+    std::cout << std::endl << std::setw(8) << "shards"
+        << std::setw(10) << "threads"
+        << std::setw(10) << "writer"
+        << std::setw(16) << "reads/s"
+        << std::setw(16) << "per thread" << std::endl;
+
+    for (size_t shards : {size_t(1), size_t(64)}) {
+        for (bool with_writer : {false, true}) {
+            for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+                measure(shards, threads, with_writer, keys);
+            }
+        }
+    }
+
+    if (failed) {
+        std::cout << "MISMATCH: a reader saw a value that does not match its key" << std::endl;
+    }
+    return (failed || mismatch) ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "dict.hpp"
+
+namespace utils {
+    // dict_t split into independently locked shards chosen by the key hash.
+    // Readers of a shard share its lock, so reads only wait for a writer to
+    // the same shard, and readers of different shards never touch the same
+    // cache line.
+    class concurrent_dict {
+    public:
+        explicit concurrent_dict(size_t shards = DEFAULT_SHARDS) {
+            size_t count = 1;
+            while (count < shards) {
+                count *= 2;
+            }
+            shards_.reset(new shard[count]);
+            shard_bits_ = 0;
+            while ((size_t(1) << shard_bits_) < count) {
+                ++shard_bits_;
+            }
+        }
+
+        size_t shard_count() const {
+            return size_t(1) << shard_bits_;
+        }
+
+        // Inserts the value unless the key is present, like utils::put.
+        template<typename T>
+        bool put(std::string_view key, T&& value) {
+            shard& s = shard_for(key);
+            std::unique_lock<std::shared_mutex> lock(s.mutex);
+            return utils::put(s.dict, key, std::forward<T>(value));
+        }
+
+        // Inserts the value or replaces the present one.
+        template<typename T>
+        void set(std::string_view key, T&& value) {
+            whatever tmp(std::forward<T>(value));
+            shard& s = shard_for(key);
+            std::unique_lock<std::shared_mutex> lock(s.mutex);
+            auto [it, inserted] = s.dict.try_emplace(key);
+            it->second = std::move(tmp);
+        }
+
+        // Returns a copy, since a reference would outlive the lock.
+        template<typename T>
+        T get(std::string_view key) const {
+            shard const& s = shard_for(key);
+            std::shared_lock<std::shared_mutex> lock(s.mutex);
+            return utils::get<T>(s.dict, key);
+        }
+
+        // Also a copy, or nothing if the key is missing or holds another
+        // type. No lock is held after a call returns, so a thread may mix
+        // any calls freely.
+        template<typename T>
+        std::optional<T> get_ptr(std::string_view key) const {
+            shard const& s = shard_for(key);
+            std::shared_lock<std::shared_mutex> lock(s.mutex);
+            T const* ptr = utils::get_ptr<T>(s.dict, key);
+            if (ptr == nullptr) {
+                return std::nullopt;
+            }
+            return *ptr;
+        }
+
+        bool remove(std::string_view key) {
+            shard& s = shard_for(key);
+            std::unique_lock<std::shared_mutex> lock(s.mutex);
+            return utils::remove(s.dict, key);
+        }
+
+        bool contains(std::string_view key) const {
+            shard const& s = shard_for(key);
+            std::shared_lock<std::shared_mutex> lock(s.mutex);
+            return utils::contains(s.dict, key);
+        }
+
+        // The shards are visited one by one, so with concurrent writers the
+        // result is not a consistent snapshot of the whole dict.
+        size_t size() const {
+            size_t result = 0;
+            for (size_t i = 0; i < shard_count(); ++i) {
+                std::shared_lock<std::shared_mutex> lock(shards_[i].mutex);
+                result += shards_[i].dict.size();
+            }
+            return result;
+        }
+
+        void clear() {
+            for (size_t i = 0; i < shard_count(); ++i) {
+                std::unique_lock<std::shared_mutex> lock(shards_[i].mutex);
+                shards_[i].dict.clear();
+            }
+        }
+
+        // Replaces the whole content at once, e.g. on a config reload. The new
+        // shards are built without holding any lock. Then all shards are
+        // locked in order and swapped together, so no lookup sees some
+        // shards old and others new. The old content is freed after the
+        // locks are released.
+        void assign(dict_t dict) {
+            std::unique_ptr<dict_t[]> parts(new dict_t[shard_count()]);
+            for (auto& [key, value] : dict) {
+                parts[index_for(key)].try_emplace(key, std::move(value));
+            }
+            std::vector<std::unique_lock<std::shared_mutex>> locks;
+            locks.reserve(shard_count());
+            for (size_t i = 0; i < shard_count(); ++i) {
+                locks.emplace_back(shards_[i].mutex);
+            }
+            for (size_t i = 0; i < shard_count(); ++i) {
+                shards_[i].dict.swap(parts[i]);
+            }
+        }
+
+        dict_t snapshot() const {
+            dict_t result;
+            for (size_t i = 0; i < shard_count(); ++i) {
+                std::shared_lock<std::shared_mutex> lock(shards_[i].mutex);
+                result.reserve(result.size() + shards_[i].dict.size());
+                for (auto const& [key, value] : shards_[i].dict) {
+                    result.try_emplace(key, value);
+                }
+            }
+            return result;
+        }
+
+    private:
+        static constexpr size_t DEFAULT_SHARDS = 64;
+        static constexpr size_t CACHE_LINE = 64;
+
+        struct alignas(CACHE_LINE) shard {
+            mutable std::shared_mutex mutex;
+            dict_t dict;
+        };
+
+        // The top bits of the hash pick the shard: flat_map uses the low
+        // ones for its control bytes and probe start.
+        size_t index_for(std::string_view key) const {
+            if (shard_bits_ == 0) {
+                return 0;
+            }
+            return std::hash<std::string_view>()(key) >> (std::numeric_limits<size_t>::digits - shard_bits_);
+        }
+
+        shard& shard_for(std::string_view key) {
+            return shards_[index_for(key)];
+        }
+
+        shard const& shard_for(std::string_view key) const {
+            return shards_[index_for(key)];
+        }
+
+        std::unique_ptr<shard[]> shards_;
+        size_t shard_bits_;
+    };
+}
@@ -1,9 +1,33 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
 #include "whatever.hpp"
 
 namespace utils {
-    typedef std::unordered_map<std::string, whatever> dict_t;
+    typedef flat_map<whatever> dict_t;
+    typedef std::pmr::vector<whatever> array_t;
+
+    template<typename T>
+    struct is_vector : std::false_type {};
+
+    template<typename T, typename Allocator>
+    struct is_vector<std::vector<T, Allocator>> : std::true_type {};
+
+    template<typename T>
+    inline constexpr bool is_vector_v = is_vector<T>::value;
 
     struct no_key_exception : public std::exception {
         char const* what() const noexcept override {
@@ -17,73 +41,162 @@ namespace utils {
         }
     };
 
+    // Integers loaded from JSON or binary are int when they fit, as they
+    // always were, and long otherwise, so no value is cut.
+    inline whatever integer_value(int64_t value, std::pmr::memory_resource* resource) {
+        if (value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max()) {
+            return whatever(std::allocator_arg, resource, static_cast<int>(value));
+        }
+        return whatever(std::allocator_arg, resource, static_cast<long>(value));
+    }
+
+    // A value computed on first access, such as a nested object of a lazily
+    // loaded JSON document. get, get_ptr, is_dict, is_array and visit_value
+    // see the computed value. Copies in the same memory resource share it,
+    // and computing it is thread-safe, so a const dict can be read from
+    // several threads. A copy into another resource computes its own value
+    // there, so it does not depend on the resource of the original.
+    class lazy_value {
+    public:
+        typedef std::pmr::polymorphic_allocator<std::byte> allocator_type;
+
+        explicit lazy_value(std::function<whatever(std::pmr::memory_resource*)> make,
+                allocator_type const& allocator = allocator_type())
+            : state_(std::make_shared<state>()), resource_(allocator.resource()) {
+            state_->make = std::move(make);
+        }
+
+        lazy_value(std::allocator_arg_t, allocator_type const& allocator, lazy_value const& other)
+            : resource_(allocator.resource()) {
+            if (*resource_ == *other.resource_) {
+                state_ = other.state_;
+            } else {
+                state_ = std::make_shared<state>();
+                state_->make = other.state_->make;
+            }
+        }
+
+        lazy_value(std::allocator_arg_t, allocator_type const& allocator, lazy_value&& other)
+            : lazy_value(std::allocator_arg, allocator, static_cast<lazy_value const&>(other)) {}
+
+        whatever const& get() const {
+            std::call_once(state_->once, [this] {
+                state_->value.emplace(state_->make(resource_));
+            });
+            return *state_->value;
+        }
+
+        // Moves the value out unless a copy of this lazy_value shares it.
+        whatever take() {
+            get();
+            if (state_.use_count() == 1) {
+                return std::move(*state_->value);
+            }
+            return *state_->value;
+        }
+
+        friend bool operator==(lazy_value const& lhs, lazy_value const& rhs) {
+            return lhs.get() == rhs.get();
+        }
+
+    private:
+        // make is never changed after construction, so copies into another
+        // resource can read it while the value is being computed.
+        struct state {
+            std::function<whatever(std::pmr::memory_resource*)> make;
+            std::once_flag once;
+            std::optional<whatever> value;
+        };
+
+        std::shared_ptr<state> state_;
+        std::pmr::memory_resource* resource_;
+    };
+
+    inline whatever const& resolve(whatever const& value) {
+        lazy_value const* lazy = whatever_cast<lazy_value>(&value);
+        return (lazy == nullptr ? value : lazy->get());
+    }
+
+    // Replaces a lazy value by its result, so that changes through the
+    // returned reference stay in the dict.
+    inline whatever& resolve(whatever& value) {
+        if (lazy_value* lazy = whatever_cast<lazy_value>(&value)) {
+            value = lazy->take();
+        }
+        return value;
+    }
+
+    // The value may refer into the dict, e.g. put(d, "copy", get<int>(d, "k")).
+    // Pointers and references from get and get_ptr are invalidated by any
+    // put that inserts a new key, since the dict may move its entries.
     template<typename T>
-    bool put(dict_t& dict, std::string const& key, T&& value) {
-        auto [it, result] = dict.try_emplace(std::move(key), whatever(std::forward<T>(value)));
+    bool put(dict_t& dict, std::string_view key, T&& value) {
+        auto [it, result] = dict.try_emplace(key, std::forward<T>(value));
         return result;
     }
 
+    // Moves the entries of other into dict, keeping the keys dict already
+    // has, like put.
+    inline void merge(dict_t& dict, dict_t&& other) {
+        dict.reserve(dict.size() + other.size());
+        for (auto& [key, value] : other) {
+            dict.try_emplace(key, std::move(value));
+        }
+    }
+
     template<typename T>
-    T const* get_ptr(dict_t const& dict, std::string const& key) {
+    T const* get_ptr(dict_t const& dict, std::string_view key) {
         auto it = dict.find(key);
         if (it == dict.end()) {
             return nullptr;
         }
 
-        try {
-            return whatever_cast<T const>(&it->second);
-        } catch (bad_whatever_cast const&) {
-            return nullptr;
-        }
+        return whatever_cast<T const>(&resolve(it->second));
     }
 
     template<typename T>
-    T* get_ptr(dict_t& dict, std::string const& key) {
+    T* get_ptr(dict_t& dict, std::string_view key) {
         auto it = dict.find(key);
         if (it == dict.end()) {
             return nullptr;
         }
 
-        try {
-            return whatever_cast<T>(&it->second);
-        } catch (bad_whatever_cast const&) {
-            return nullptr;
-        }
+        return whatever_cast<T>(&resolve(it->second));
     }
 
     template<typename T>
-    T const& get(dict_t const& dict, std::string const& key) {
+    T const& get(dict_t const& dict, std::string_view key) {
         auto it = dict.find(key);
         if (it == dict.end()) {
             throw no_key_exception();
         }
 
-        try {
-            return whatever_cast<T const&>(it->second);
-        } catch (bad_whatever_cast const& error) {
+        auto value = whatever_cast<T const>(&resolve(it->second));
+        if (value == nullptr) {
             throw invalid_type_exception();
         }
+        return *value;
     }
 
     template<typename T>
-    T& get(dict_t& dict, std::string const& key) {
+    T& get(dict_t& dict, std::string_view key) {
         auto it = dict.find(key);
         if (it == dict.end()) {
             throw no_key_exception();
         }
 
-        try {
-            return whatever_cast<T&>(it->second);
-        } catch (bad_whatever_cast const& error) {
+        auto value = whatever_cast<T>(&resolve(it->second));
+        if (value == nullptr) {
             throw invalid_type_exception();
         }
+        return *value;
     }
 
-    inline bool remove(dict_t& dict, std::string const& key) {
+    inline bool remove(dict_t& dict, std::string_view key) {
         return dict.erase(key) != 0;
     }
 
-    inline bool contains(dict_t const& dict, std::string const& key) {
+    inline bool contains(dict_t const& dict, std::string_view key) {
         return dict.find(key) != dict.end();
     }
 
@@ -95,7 +208,171 @@ namespace utils {
         dict.clear();
     }
 
-    inline bool is_dict(dict_t const& dict, std::string const& key) {
+    inline bool is_dict(dict_t const& dict, std::string_view key) {
         return get_ptr<dict_t>(dict, key) != nullptr;
     }
+
+    inline bool is_array(dict_t const& dict, std::string_view key) {
+        return get_ptr<array_t>(dict, key) != nullptr;
+    }
+
+    // Keys of nested dicts, such as "a.b.c", split and hashed once, so that
+    // repeated lookups by the path neither hash nor allocate. Keys that
+    // contain the separator are given one by one with of_keys.
+    class key_path {
+    public:
+        explicit key_path(std::string_view path, char separator = '.') : path_(path) {
+            size_t begin = 0;
+            while (true) {
+                size_t end = path_.find(separator, begin);
+                if (end == std::string::npos) {
+                    add(begin, path_.size());
+                    break;
+                }
+                add(begin, end);
+                begin = end + 1;
+            }
+        }
+
+        static key_path of_keys(std::initializer_list<std::string_view> keys) {
+            key_path result;
+            for (std::string_view key : keys) {
+                result.path_.append(key);
+            }
+            size_t begin = 0;
+            for (std::string_view key : keys) {
+                result.add(begin, begin + key.size());
+                begin += key.size();
+            }
+            return result;
+        }
+
+        size_t size() const {
+            return segments_.size();
+        }
+
+        std::string_view key(size_t i) const {
+            return std::string_view(path_).substr(segments_[i].begin, segments_[i].size);
+        }
+
+        size_t hash(size_t i) const {
+            return segments_[i].hash;
+        }
+
+    private:
+        struct segment {
+            size_t begin;
+            size_t size;
+            size_t hash;
+        };
+
+        key_path() = default;
+
+        void add(size_t begin, size_t end) {
+            std::string_view key = std::string_view(path_).substr(begin, end - begin);
+            segments_.push_back({begin, end - begin, dict_t::hash(key)});
+        }
+
+        std::string path_;
+        std::vector<segment> segments_;
+    };
+
+    enum class path_error {
+        none,
+        no_key,
+        invalid_type
+    };
+
+    // Last value of the path in dict, which is dict_t or dict_t const, with
+    // lazy values on the way computed. Returns nullptr and sets error if a
+    // key is missing (or the path is empty) or a value on the way is not a
+    // dict.
+    template<typename Dict>
+    std::conditional_t<std::is_const_v<Dict>, whatever const*, whatever*>
+    find_path(Dict& dict, key_path const& path, path_error& error) {
+        error = path_error::none;
+        if (path.size() == 0) {
+            error = path_error::no_key;
+            return nullptr;
+        }
+        Dict* current = &dict;
+        for (size_t i = 0; ; ++i) {
+            auto it = current->find(path.key(i), path.hash(i));
+            if (it == current->end()) {
+                error = path_error::no_key;
+                return nullptr;
+            }
+            auto& value = resolve(it->second);
+            if (i + 1 == path.size()) {
+                return &value;
+            }
+            current = whatever_cast<Dict>(&value);
+            if (current == nullptr) {
+                error = path_error::invalid_type;
+                return nullptr;
+            }
+        }
+    }
+
+    // Value at the end of the path, or nullptr if a key is missing, a value
+    // on the way is not a dict or the last one is not a T.
+    template<typename T>
+    T const* get_ptr_path(dict_t const& dict, key_path const& path) {
+        path_error error;
+        whatever const* value = find_path(dict, path, error);
+        return (value == nullptr ? nullptr : whatever_cast<T const>(value));
+    }
+
+    template<typename T>
+    T* get_ptr_path(dict_t& dict, key_path const& path) {
+        path_error error;
+        whatever* value = find_path(dict, path, error);
+        return (value == nullptr ? nullptr : whatever_cast<T>(value));
+    }
+
+    inline void throw_path_error(path_error error) {
+        if (error == path_error::no_key) {
+            throw no_key_exception();
+        }
+        throw invalid_type_exception();
+    }
+
+    // Throws no_key_exception if a key is missing and invalid_type_exception
+    // if a value on the way is not a dict or the last one is not a T.
+    template<typename T>
+    T const& get_path(dict_t const& dict, key_path const& path) {
+        path_error error;
+        whatever const* found = find_path(dict, path, error);
+        T const* value = (found == nullptr ? nullptr : whatever_cast<T const>(found));
+        if (value == nullptr) {
+            throw_path_error(error);
+        }
+        return *value;
+    }
+
+    template<typename T>
+    T& get_path(dict_t& dict, key_path const& path) {
+        path_error error;
+        whatever* found = find_path(dict, path, error);
+        T* value = (found == nullptr ? nullptr : whatever_cast<T>(found));
+        if (value == nullptr) {
+            throw_path_error(error);
+        }
+        return *value;
+    }
+
+    // Calls f with the value if it holds one of the types dicts are serialized
+    // with: integers, double, float, bool, std::string, dict_t, array_t and
+    // vectors of those scalars, computing lazy values first, with one table
+    // lookup. Returns false for empty values and any other type.
+    template<typename F>
+    bool visit_value(whatever const& raw, F&& f) {
+        whatever const& value = resolve(raw);
+        return value.visit<int, std::string, double, bool, dict_t, array_t, float,
+            char, short, long, unsigned char, unsigned int, unsigned short, unsigned long,
+            std::vector<int>, std::vector<double>, std::vector<std::string>, std::vector<bool>,
+            std::vector<char>, std::vector<short>, std::vector<long>, std::vector<unsigned char>,
+            std::vector<unsigned int>, std::vector<unsigned short>, std::vector<unsigned long>,
+            std::vector<float>>(f);
+    }
 }
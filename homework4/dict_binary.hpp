@@ -0,0 +1,571 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dict.hpp"
+
+// Binary format of dict_t, little-endian, all offsets from the start of the buffer:
+//   header      "DICT", u32 version, u64 offset of the root dict
+//   value slot  u8 type, 7 bytes padding, u64 payload (the value itself for
+//               scalars, the offset of the node for everything else)
+//   string      u64 size, bytes
+//   dict        u64 count, count entries {u64 key offset, u64 key size, slot}
+//               sorted by key bytes
+//   array       u64 count, count slots
+//   int/double array  u64 count, count 8-byte elements
+// Nodes are 8-byte aligned, so the buffer can be memory-mapped and queried in
+// place through binary_view.
+
+namespace utils {
+    struct invalid_format_exception : public std::exception {
+        char const* what() const noexcept override {
+            return "Invalid serialized data format.";
+        }
+    };
+
+    enum class binary_type : uint8_t {
+        null = 0,
+        boolean = 1,
+        integer = 2,
+        number = 3,
+        string = 4,
+        dict = 5,
+        array = 6,
+        int_array = 7,
+        double_array = 8
+    };
+
+    namespace binary_format {
+        char const MAGIC[4] = {'D', 'I', 'C', 'T'};
+        uint32_t const VERSION = 1;
+        size_t const HEADER_SIZE = 16;
+        size_t const SLOT_SIZE = 16;
+        size_t const ENTRY_SIZE = 16 + SLOT_SIZE;
+        // Nesting loaded into a dict_t, so that hostile input cannot exhaust
+        // the stack.
+        size_t const MAX_DEPTH = 512;
+
+        inline uint64_t load_u64(char const* src) {
+            uint64_t result = 0;
+            for (size_t i = 0; i < 8; ++i) {
+                result |= static_cast<uint64_t>(static_cast<unsigned char>(src[i])) << (8 * i);
+            }
+            return result;
+        }
+
+        inline void store_u64(char* dst, uint64_t value) {
+            for (size_t i = 0; i < 8; ++i) {
+                dst[i] = static_cast<char>(value >> (8 * i));
+            }
+        }
+
+        inline uint64_t double_bits(double value) {
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        inline double bits_double(uint64_t bits) {
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+    }
+
+    // Builds the binary format from a stream of events, in the same order as a
+    // JSON document: begin_dict, key, value, ..., end_dict.
+    class binary_writer {
+    public:
+        binary_writer() : buffer_(binary_format::HEADER_SIZE, '\0') {
+            std::memcpy(&buffer_[0], binary_format::MAGIC, sizeof(binary_format::MAGIC));
+            for (size_t i = 0; i < 4; ++i) {
+                buffer_[4 + i] = static_cast<char>(binary_format::VERSION >> (8 * i));
+            }
+        }
+
+        void key(std::string_view key) {
+            frame& top = stack_.back();
+            top.key_offset = buffer_.size();
+            top.key_size = key.size();
+            buffer_.append(key.data(), key.size());
+        }
+
+        void null() {
+            add(binary_type::null, 0);
+        }
+
+        void boolean(bool value) {
+            add(binary_type::boolean, value ? 1 : 0);
+        }
+
+        void integer(int64_t value) {
+            add(binary_type::integer, static_cast<uint64_t>(value));
+        }
+
+        void number(double value) {
+            add(binary_type::number, binary_format::double_bits(value));
+        }
+
+        void string(std::string_view value) {
+            uint64_t offset = append_u64(value.size());
+            buffer_.append(value.data(), value.size());
+            add(binary_type::string, offset);
+        }
+
+        template<typename T>
+        void numbers(T const* data, size_t count) {
+            uint64_t offset = append_u64(count);
+            for (size_t i = 0; i < count; ++i) {
+                if constexpr (std::is_integral_v<T>) {
+                    append_u64(static_cast<uint64_t>(static_cast<int64_t>(data[i])));
+                } else {
+                    append_u64(binary_format::double_bits(static_cast<double>(data[i])));
+                }
+            }
+            add(std::is_integral_v<T> ? binary_type::int_array : binary_type::double_array, offset);
+        }
+
+        void begin_dict() {
+            stack_.push_back(frame{0, 0, {}});
+        }
+
+        void end_dict() {
+            std::vector<entry>& entries = stack_.back().entries;
+            std::sort(entries.begin(), entries.end(), [this](entry const& lhs, entry const& rhs) {
+                return key_at(lhs) < key_at(rhs);
+            });
+            uint64_t offset = append_u64(entries.size());
+            for (entry const& item : entries) {
+                append_u64(item.key_offset);
+                append_u64(item.key_size);
+                append_slot(item.type, item.payload);
+            }
+            close(binary_type::dict, offset);
+        }
+
+        void begin_array() {
+            stack_.push_back(frame{0, 0, {}});
+        }
+
+        void end_array() {
+            std::vector<entry>& entries = stack_.back().entries;
+            uint64_t offset = append_u64(entries.size());
+            for (entry const& item : entries) {
+                append_slot(item.type, item.payload);
+            }
+            close(binary_type::array, offset);
+        }
+
+        std::string const& buffer() const {
+            return buffer_;
+        }
+
+    private:
+        struct entry {
+            uint64_t key_offset;
+            uint64_t key_size;
+            binary_type type;
+            uint64_t payload;
+        };
+
+        struct frame {
+            uint64_t key_offset;
+            uint64_t key_size;
+            std::vector<entry> entries;
+        };
+
+        std::string_view key_at(entry const& item) const {
+            return std::string_view(buffer_.data() + item.key_offset, item.key_size);
+        }
+
+        void align() {
+            buffer_.resize((buffer_.size() + 7) & ~size_t(7), '\0');
+        }
+
+        uint64_t append_u64(uint64_t value) {
+            align();
+            uint64_t offset = buffer_.size();
+            buffer_.resize(offset + 8);
+            binary_format::store_u64(&buffer_[offset], value);
+            return offset;
+        }
+
+        // The type goes to the low byte of the first word, the rest is padding.
+        void append_slot(binary_type type, uint64_t payload) {
+            append_u64(static_cast<uint64_t>(type));
+            append_u64(payload);
+        }
+
+        void add(binary_type type, uint64_t payload) {
+            frame& top = stack_.back();
+            top.entries.push_back(entry{top.key_offset, top.key_size, type, payload});
+        }
+
+        void close(binary_type type, uint64_t offset) {
+            stack_.pop_back();
+            if (stack_.empty()) {
+                binary_format::store_u64(&buffer_[8], offset);
+            } else {
+                add(type, offset);
+            }
+        }
+
+        std::string buffer_;
+        std::vector<frame> stack_;
+    };
+
+    class binary_dict;
+    class binary_array;
+
+    // A value inside a binary buffer, read in place.
+    class binary_value {
+    public:
+        binary_value(char const* data, size_t size, binary_type type, uint64_t payload)
+            : data_(data), size_(size), type_(type), payload_(payload) {}
+
+        binary_type type() const {
+            return type_;
+        }
+
+        bool is_null() const {
+            return type_ == binary_type::null;
+        }
+
+        bool as_bool() const {
+            expect(binary_type::boolean);
+            return payload_ != 0;
+        }
+
+        int64_t as_int() const {
+            expect(binary_type::integer);
+            return static_cast<int64_t>(payload_);
+        }
+
+        double as_double() const {
+            expect(binary_type::number);
+            return binary_format::bits_double(payload_);
+        }
+
+        std::string_view as_string() const {
+            expect(binary_type::string);
+            uint64_t length = binary_format::load_u64(at(payload_, 8));
+            return std::string_view(at(payload_ + 8, length), length);
+        }
+
+        binary_dict as_dict() const;
+        binary_array as_array() const;
+
+    private:
+        void expect(binary_type type) const {
+            if (type_ != type) {
+                throw invalid_type_exception();
+            }
+        }
+
+        char const* at(uint64_t offset, uint64_t length) const {
+            if (offset > size_ || length > size_ - offset) {
+                throw invalid_format_exception();
+            }
+            return data_ + offset;
+        }
+
+        char const* data_;
+        size_t size_;
+        binary_type type_;
+        uint64_t payload_;
+    };
+
+    class binary_dict {
+    public:
+        binary_dict(char const* data, size_t size, uint64_t offset) : data_(data), size_(size) {
+            if (offset > size_ || size_ - offset < 8) {
+                throw invalid_format_exception();
+            }
+            count_ = binary_format::load_u64(data_ + offset);
+            if (count_ > (size_ - offset - 8) / binary_format::ENTRY_SIZE) {
+                throw invalid_format_exception();
+            }
+            entries_ = data_ + offset + 8;
+            // Everything a node refers to is written before it, so the keys and
+            // values are bounded by the node offset, which also rules out cycles.
+            size_ = offset;
+        }
+
+        size_t size() const {
+            return count_;
+        }
+
+        std::string_view key(size_t idx) const {
+            char const* item = entries_ + idx * binary_format::ENTRY_SIZE;
+            uint64_t offset = binary_format::load_u64(item);
+            uint64_t length = binary_format::load_u64(item + 8);
+            if (offset > size_ || length > size_ - offset) {
+                throw invalid_format_exception();
+            }
+            return std::string_view(data_ + offset, length);
+        }
+
+        binary_value value(size_t idx) const {
+            char const* slot = entries_ + idx * binary_format::ENTRY_SIZE + 16;
+            return binary_value(data_, size_, static_cast<binary_type>(slot[0]), binary_format::load_u64(slot + 8));
+        }
+
+        // Binary search over the sorted entry table.
+        std::optional<binary_value> find(std::string_view key) const {
+            size_t lo = 0;
+            size_t hi = count_;
+            while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                std::string_view current = this->key(mid);
+                if (current == key) {
+                    return value(mid);
+                }
+                if (current < key) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            return std::nullopt;
+        }
+
+        bool contains(std::string_view key) const {
+            return find(key).has_value();
+        }
+
+    private:
+        char const* data_;
+        size_t size_;
+        char const* entries_;
+        size_t count_;
+    };
+
+    class binary_array {
+    public:
+        binary_array(char const* data, size_t size, binary_type type, uint64_t offset)
+                : data_(data), size_(size), type_(type) {
+            if (offset > size_ || size_ - offset < 8) {
+                throw invalid_format_exception();
+            }
+            count_ = binary_format::load_u64(data_ + offset);
+            size_t element_size = (type_ == binary_type::array ? binary_format::SLOT_SIZE : 8);
+            if (count_ > (size_ - offset - 8) / element_size) {
+                throw invalid_format_exception();
+            }
+            elements_ = data_ + offset + 8;
+            size_ = offset;
+        }
+
+        size_t size() const {
+            return count_;
+        }
+
+        // Elements of int and double arrays are returned as integer and number values.
+        binary_value operator[](size_t idx) const {
+            if (type_ == binary_type::array) {
+                char const* slot = elements_ + idx * binary_format::SLOT_SIZE;
+                return binary_value(data_, size_, static_cast<binary_type>(slot[0]), binary_format::load_u64(slot + 8));
+            }
+            binary_type element_type = (type_ == binary_type::int_array ? binary_type::integer : binary_type::number);
+            return binary_value(data_, size_, element_type, binary_format::load_u64(elements_ + idx * 8));
+        }
+
+        binary_type type() const {
+            return type_;
+        }
+
+    private:
+        char const* data_;
+        size_t size_;
+        binary_type type_;
+        char const* elements_;
+        size_t count_;
+    };
+
+    inline binary_dict binary_value::as_dict() const {
+        expect(binary_type::dict);
+        return binary_dict(data_, size_, payload_);
+    }
+
+    inline binary_array binary_value::as_array() const {
+        if (type_ != binary_type::array && type_ != binary_type::int_array && type_ != binary_type::double_array) {
+            throw invalid_type_exception();
+        }
+        return binary_array(data_, size_, type_, payload_);
+    }
+
+    // Read-only view of a whole buffer in the binary format. The buffer is
+    // neither copied nor owned and must outlive the view.
+    class binary_view {
+    public:
+        binary_view(char const* data, size_t size) : data_(data), size_(size) {
+            if (size_ < binary_format::HEADER_SIZE
+                    || std::memcmp(data_, binary_format::MAGIC, sizeof(binary_format::MAGIC)) != 0
+                    || static_cast<uint32_t>(binary_format::load_u64(data_ + 4)) != binary_format::VERSION) {
+                throw invalid_format_exception();
+            }
+        }
+
+        binary_dict root() const {
+            return binary_dict(data_, size_, binary_format::load_u64(data_ + 8));
+        }
+
+    private:
+        char const* data_;
+        size_t size_;
+    };
+
+    inline void binary_write_value(binary_writer& writer, whatever const& value);
+
+    inline void binary_write_dict(binary_writer& writer, dict_t const& dict) {
+        writer.begin_dict();
+        for (auto const& [key, value] : dict) {
+            writer.key(key);
+            binary_write_value(writer, value);
+        }
+        writer.end_dict();
+    }
+
+    inline void binary_write_value(binary_writer& writer, whatever const& value) {
+        bool const is_known = visit_value(value, [&writer](auto const& x) {
+            typedef std::decay_t<decltype(x)> type;
+            if constexpr (std::is_same_v<type, bool>) {
+                writer.boolean(x);
+            } else if constexpr (std::is_integral_v<type>) {
+                writer.integer(static_cast<int64_t>(x));
+            } else if constexpr (std::is_floating_point_v<type>) {
+                writer.number(x);
+            } else if constexpr (std::is_same_v<type, std::string>) {
+                writer.string(x);
+            } else if constexpr (std::is_same_v<type, dict_t>) {
+                binary_write_dict(writer, x);
+            } else if constexpr (std::is_arithmetic_v<typename type::value_type>
+                    && !std::is_same_v<typename type::value_type, bool>) {
+                writer.numbers(x.data(), x.size());
+            } else {
+                writer.begin_array();
+                for (auto const& item : x) {
+                    if constexpr (std::is_same_v<type, array_t>) {
+                        binary_write_value(writer, item);
+                    } else if constexpr (std::is_same_v<typename type::value_type, bool>) {
+                        writer.boolean(item);
+                    } else {
+                        writer.string(item);
+                    }
+                }
+                writer.end_array();
+            }
+        });
+        if (!is_known) {
+            writer.null();
+        }
+    }
+
+    // Integers load as int, or long if they do not fit, like from JSON; int
+    // arrays load as std::vector<int>, or std::vector<long> if an element
+    // does not fit, and double arrays as std::vector<double>.
+    // Like json_to_value, holders, dicts and arrays are allocated from the
+    // given resource, while strings and int and double vectors keep their
+    // buffers on the global heap.
+    // Throws invalid_format_exception for nesting deeper than MAX_DEPTH.
+    inline whatever binary_to_value(binary_value const& value,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource(), size_t depth = 0);
+
+    inline void binary_to_dict(binary_dict const& src, dict_t& dict, size_t depth = 0) {
+        if (depth == binary_format::MAX_DEPTH) {
+            throw invalid_format_exception();
+        }
+        dict.reserve(dict.size() + src.size());
+        for (size_t i = 0; i < src.size(); ++i) {
+            dict.try_emplace(src.key(i), binary_to_value(src.value(i), dict.get_allocator().resource(), depth + 1));
+        }
+    }
+
+    inline whatever binary_to_value(binary_value const& value, std::pmr::memory_resource* resource, size_t depth) {
+        switch (value.type()) {
+            case binary_type::boolean:
+                return whatever(std::allocator_arg, resource, value.as_bool());
+            case binary_type::integer:
+                return integer_value(value.as_int(), resource);
+            case binary_type::number:
+                return whatever(std::allocator_arg, resource, value.as_double());
+            case binary_type::string:
+                return whatever(std::allocator_arg, resource, std::string(value.as_string()));
+            case binary_type::dict: {
+                dict_t tmp(resource);
+                binary_to_dict(value.as_dict(), tmp, depth);
+                return whatever(std::allocator_arg, resource, std::move(tmp));
+            }
+            case binary_type::array: {
+                if (depth == binary_format::MAX_DEPTH) {
+                    throw invalid_format_exception();
+                }
+                binary_array src = value.as_array();
+                array_t tmp(resource);
+                tmp.reserve(src.size());
+                for (size_t i = 0; i < src.size(); ++i) {
+                    tmp.push_back(binary_to_value(src[i], resource, depth + 1));
+                }
+                return whatever(std::allocator_arg, resource, std::move(tmp));
+            }
+            case binary_type::int_array: {
+                binary_array src = value.as_array();
+                bool fits_int = true;
+                for (size_t i = 0; i < src.size() && fits_int; ++i) {
+                    int64_t const item = src[i].as_int();
+                    fits_int = (item >= std::numeric_limits<int>::min() && item <= std::numeric_limits<int>::max());
+                }
+                if (fits_int) {
+                    std::vector<int> tmp(src.size());
+                    for (size_t i = 0; i < src.size(); ++i) {
+                        tmp[i] = static_cast<int>(src[i].as_int());
+                    }
+                    return whatever(std::allocator_arg, resource, std::move(tmp));
+                }
+                std::vector<long> tmp(src.size());
+                for (size_t i = 0; i < src.size(); ++i) {
+                    tmp[i] = static_cast<long>(src[i].as_int());
+                }
+                return whatever(std::allocator_arg, resource, std::move(tmp));
+            }
+            case binary_type::double_array: {
+                binary_array src = value.as_array();
+                std::vector<double> tmp(src.size());
+                for (size_t i = 0; i < src.size(); ++i) {
+                    tmp[i] = src[i].as_double();
+                }
+                return whatever(std::allocator_arg, resource, std::move(tmp));
+            }
+            default:
+                return whatever(std::allocator_arg, resource);
+        }
+    }
+
+    inline void save_to_binary(std::ostream& os, dict_t const& dict) {
+        binary_writer writer;
+        binary_write_dict(writer, dict);
+        os.write(writer.buffer().data(), writer.buffer().size());
+    }
+
+    inline bool load_from_binary(std::istream& is, dict_t& dict) {
+        std::string buffer((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        try {
+            binary_to_dict(binary_view(buffer.data(), buffer.size()).root(), dict);
+        } catch (invalid_format_exception const&) {
+            return false;
+        }
+        return true;
+    }
+}
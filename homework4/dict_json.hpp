@@ -1,96 +1,385 @@
 #pragma once
 
+#include <charconv>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "nlohmann/json.hpp"
 #include "dict.hpp"
 
 using json = nlohmann::json;
 
+template<typename F>
+bool visit_int(utils::whatever const& value, F&& f) {
+    return value.visit<int, char, short, long, unsigned char, unsigned int, unsigned short, unsigned long>(
+        std::forward<F>(f));
+}
+
 inline std::optional<int> get_int(utils::whatever const& value) {
-    if (value.empty()) {
-        return std::nullopt;
+    std::optional<int> result;
+    visit_int(value, [&result](auto const& x) {
+        result = static_cast<int>(x);
+    });
+    return result;
+}
+
+// Widens integers to long long, or unsigned long long for unsigned types,
+// so that every value keeps all its bits.
+template<typename T>
+auto json_integer(T value) {
+    if constexpr (std::is_unsigned_v<T>) {
+        return static_cast<unsigned long long>(value);
+    } else {
+        return static_cast<long long>(value);
     }
-    if (value.type_info() == typeid(int)) {
-        return utils::whatever_cast<int>(value);
+}
+
+// Calls f with every value representable in JSON: integers are passed
+// through json_integer, containers as dict_t, array_t or a vector of plain
+// values.
+template<typename F>
+bool visit_json(utils::whatever const& value, F&& f) {
+    return utils::visit_value(value, [&f](auto const& x) {
+        typedef std::decay_t<decltype(x)> type;
+        if constexpr (std::is_integral_v<type> && !std::is_same_v<type, bool>) {
+            f(json_integer(x));
+        } else {
+            f(x);
+        }
+    });
+}
+
+inline json json_from_dict(utils::dict_t const& dict);
+
+inline json json_from_value(utils::whatever const& value) {
+    json result;
+    visit_json(value, [&result](auto const& x) {
+        typedef std::decay_t<decltype(x)> type;
+        if constexpr (std::is_same_v<type, utils::dict_t>) {
+            result = json_from_dict(x);
+        } else if constexpr (std::is_same_v<type, utils::array_t>) {
+            result = json::array();
+            for (auto const& item : x) {
+                result.push_back(json_from_value(item));
+            }
+        } else if constexpr (utils::is_vector_v<type>) {
+            result = json::array();
+            for (auto const& item : x) {
+                if constexpr (std::is_integral_v<typename type::value_type>
+                        && !std::is_same_v<typename type::value_type, bool>) {
+                    result.push_back(json_integer(item));
+                } else {
+                    result.push_back(item);
+                }
+            }
+        } else {
+            result = x;
+        }
+    });
+    return result;
+}
+
+inline json json_from_dict(utils::dict_t const& dict) {
+    json obj = json::object();
+    for (auto const& [key, value] : dict) {
+        obj[std::string(key)] = json_from_value(value);
     }
-    if (value.type_info() == typeid(char)) {
-        return static_cast<int>(utils::whatever_cast<char>(value));
+    return obj;
+}
+
+inline void json_to_dict(json& obj, utils::dict_t& dict);
+
+// Holders, nested dicts and arrays are allocated from the given resource,
+// the characters of long strings from the global heap. Integers load like
+// from load_from_json.
+inline utils::whatever json_to_value(json& value,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
+    if (value.is_boolean()) {
+        return utils::whatever(std::allocator_arg, resource, value.get<bool>());
+    } else if (value.is_string()) {
+        return utils::whatever(std::allocator_arg, resource, std::move(value.get_ref<std::string&>()));
+    } else if (value.is_number_unsigned() && value.get<uint64_t>() > std::numeric_limits<long>::max()) {
+        return utils::whatever(std::allocator_arg, resource, static_cast<unsigned long>(value.get<uint64_t>()));
+    } else if (value.is_number_integer()) {
+        return utils::integer_value(value.get<int64_t>(), resource);
+    } else if (value.is_number_float()) {
+        return utils::whatever(std::allocator_arg, resource, value.get<double>());
+    } else if (value.is_object()) {
+        utils::dict_t tmp(resource);
+        json_to_dict(value, tmp);
+        return utils::whatever(std::allocator_arg, resource, std::move(tmp));
+    } else if (value.is_array()) {
+        utils::array_t tmp(resource);
+        tmp.reserve(value.size());
+        for (auto& item : value) {
+            tmp.push_back(json_to_value(item, resource));
+        }
+        return utils::whatever(std::allocator_arg, resource, std::move(tmp));
     }
-    if (value.type_info() == typeid(short)) {
-        return static_cast<int>(utils::whatever_cast<short>(value));
+    return utils::whatever(std::allocator_arg, resource);
+}
+
+// The whole tree uses the memory resource of dict. Keys already in dict
+// keep their values, like with put.
+inline void json_to_dict(json& obj, utils::dict_t& dict) {
+    for (auto& [key, value] : obj.items()) {
+        utils::put(dict, key, json_to_value(value, dict.get_allocator().resource()));
     }
-    if (value.type_info() == typeid(long)) {
-        return static_cast<int>(utils::whatever_cast<long>(value));
+}
+
+inline void json_write_string(std::ostream& os, std::string_view str) {
+    char const* hex_digits = "0123456789abcdef";
+    os.put('"');
+    size_t begin = 0;
+    for (size_t i = 0; i < str.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        os.write(str.data() + begin, i - begin);
+        begin = i + 1;
+        switch (c) {
+            case '"': os.write("\\\"", 2); break;
+            case '\\': os.write("\\\\", 2); break;
+            case '\b': os.write("\\b", 2); break;
+            case '\f': os.write("\\f", 2); break;
+            case '\n': os.write("\\n", 2); break;
+            case '\r': os.write("\\r", 2); break;
+            case '\t': os.write("\\t", 2); break;
+            default: {
+                char escaped[] = {'\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xf]};
+                os.write(escaped, sizeof(escaped));
+            }
+        }
     }
-    if (value.type_info() == typeid(unsigned char)) {
-        return static_cast<int>(utils::whatever_cast<unsigned char>(value));
+    os.write(str.data() + begin, str.size() - begin);
+    os.put('"');
+}
+
+template<typename T>
+void json_write_int(std::ostream& os, T value) {
+    char buffer[24];
+    auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    os.write(buffer, end - buffer);
+}
+
+// Shortest round-trip form; integral values keep a ".0" so they load back
+// as double, non-finite values become null like in nlohmann::json.
+inline void json_write_double(std::ostream& os, double value) {
+    if (!std::isfinite(value)) {
+        os.write("null", 4);
+        return;
     }
-    if (value.type_info() == typeid(unsigned int)) {
-        return static_cast<int>(utils::whatever_cast<unsigned int>(value));
+    char buffer[32];
+    auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    os.write(buffer, end - buffer);
+    if (std::string_view(buffer, end - buffer).find_first_of(".e") == std::string_view::npos) {
+        os.write(".0", 2);
     }
-    if (value.type_info() == typeid(unsigned short)) {
-        return static_cast<int>(utils::whatever_cast<unsigned short>(value));
+}
+
+inline void json_write_dict(std::ostream& os, utils::dict_t const& dict);
+
+template<typename T>
+void json_write(std::ostream& os, T const& x);
+
+inline void json_write_value(std::ostream& os, utils::whatever const& value) {
+    bool const is_known = visit_json(value, [&os](auto const& x) {
+        json_write(os, x);
+    });
+    if (!is_known) {
+        os.write("null", 4);
     }
-    if (value.type_info() == typeid(unsigned long)) {
-        return static_cast<int>(utils::whatever_cast<unsigned long>(value));
+}
+
+template<typename T>
+void json_write(std::ostream& os, T const& x) {
+    if constexpr (std::is_same_v<T, bool>) {
+        os.write(x ? "true" : "false", x ? 4 : 5);
+    } else if constexpr (std::is_integral_v<T>) {
+        json_write_int(os, x);
+    } else if constexpr (std::is_floating_point_v<T>) {
+        json_write_double(os, x);
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        json_write_string(os, x);
+    } else if constexpr (std::is_same_v<T, utils::dict_t>) {
+        json_write_dict(os, x);
+    } else if constexpr (std::is_same_v<T, utils::whatever>) {
+        json_write_value(os, x);
+    } else {
+        os.put('[');
+        bool first = true;
+        for (auto const& item : x) {
+            if (!first) {
+                os.put(',');
+            }
+            first = false;
+            json_write(os, static_cast<typename T::value_type const&>(item));
+        }
+        os.put(']');
     }
-    return std::nullopt;
 }
 
-inline json json_from_dict(utils::dict_t const& dict) {
-    json obj;
+inline void json_write_dict(std::ostream& os, utils::dict_t const& dict) {
+    os.put('{');
+    bool first = true;
     for (auto const& [key, value] : dict) {
-        auto int_value = get_int(value);
-        if (int_value != std::nullopt) {
-            obj[key] = int_value.value();
-        } else if (utils::get_ptr<std::string>(dict, key)) {
-            obj[key] = utils::whatever_cast<std::string>(value);
-        } else if (utils::get_ptr<double>(dict, key)) {
-            obj[key] = utils::whatever_cast<double>(value);
-        } else if (utils::get_ptr<bool>(dict, key)) {
-            obj[key] = utils::whatever_cast<bool>(value);
-        } else if (utils::is_dict(dict, key)) {
-            obj[key] = json_from_dict(utils::whatever_cast<utils::dict_t>(value));
-        } else {
-            obj[key] = {};
+        if (!first) {
+            os.put(',');
         }
+        first = false;
+        json_write_string(os, key);
+        os.put(':');
+        json_write_value(os, value);
     }
-    return obj;
+    os.put('}');
 }
 
-inline void json_to_dict(json& obj, utils::dict_t& dict) {
-    for (auto& [key, value] : obj.items()) {
-        if (value.is_boolean()) {
-            utils::put(dict, std::string(key), value.get<bool>());
-        } else if (value.is_string()) {
-            utils::put(dict, std::string(key), value.get<std::string>());
-        } else if (value.is_number_integer()) {
-            utils::put(dict, std::string(key), value.get<int>());
-        } else if (value.is_number_float()) {
-            utils::put(dict, std::string(key), value.get<double>());
-        } else if (value.is_object()) {
-            utils::dict_t tmp;
-            json_to_dict(value, tmp);
-            utils::put(dict, std::string(key), tmp);
-        } else {
-            utils::put(dict, std::string(key), utils::whatever());
+// Builds dict_t straight from nlohmann::json SAX events, in the memory
+// resource of the target dict except for long strings (see json_to_value)
+// and the parser's own scratch memory. The stack holds the dict or array
+// every open container is written to. A duplicate key replaces the earlier
+// value, like in nlohmann::json. Integers are int when they fit and long,
+// or unsigned long above its range, otherwise.
+class dict_sax_handler {
+public:
+    explicit dict_sax_handler(utils::dict_t& dict) : root_(dict) {}
+
+    bool is_object() const {
+        return is_object_;
+    }
+
+    bool null() {
+        return put(utils::whatever());
+    }
+
+    bool boolean(bool value) {
+        return put(value);
+    }
+
+    bool number_integer(json::number_integer_t value) {
+        return put(utils::integer_value(value, root_.get_allocator().resource()));
+    }
+
+    bool number_unsigned(json::number_unsigned_t value) {
+        if (value > static_cast<json::number_unsigned_t>(std::numeric_limits<long>::max())) {
+            return put(static_cast<unsigned long>(value));
         }
+        return number_integer(static_cast<json::number_integer_t>(value));
+    }
+
+    bool number_float(json::number_float_t value, json::string_t const&) {
+        return put(static_cast<double>(value));
+    }
+
+    bool string(json::string_t& value) {
+        return put(std::move(value));
+    }
+
+    bool binary(json::binary_t&) {
+        return put(utils::whatever());
+    }
+
+    bool key(json::string_t& value) {
+        key_ = std::move(value);
+        return true;
+    }
+
+    bool start_object(size_t) {
+        if (stack_.empty()) {
+            stack_.push_back({&root_, nullptr});
+            return is_object_ = true;
+        }
+        utils::whatever* value = open();
+        *value = utils::dict_t();
+        stack_.push_back({utils::whatever_cast<utils::dict_t>(value), nullptr});
+        return true;
+    }
+
+    bool end_object() {
+        return close();
     }
-}
+
+    bool start_array(size_t) {
+        if (stack_.empty()) {
+            return false;
+        }
+        utils::whatever* value = open();
+        *value = utils::array_t();
+        stack_.push_back({nullptr, utils::whatever_cast<utils::array_t>(value)});
+        return true;
+    }
+
+    bool end_array() {
+        return close();
+    }
+
+    template<typename Exception>
+    bool parse_error(size_t, std::string const&, Exception const& error) {
+        throw error;
+    }
+
+private:
+    struct frame {
+        utils::dict_t* dict;
+        utils::array_t* array;
+    };
+
+    // Slot for the next value in the current container.
+    utils::whatever* open() {
+        frame& top = stack_.back();
+        if (top.array != nullptr) {
+            return &top.array->emplace_back();
+        }
+        auto [it, inserted] = top.dict->try_emplace(key_);
+        return &it->second;
+    }
+
+    bool close() {
+        stack_.pop_back();
+        return true;
+    }
+
+    template<typename T>
+    bool put(T&& value) {
+        if (stack_.empty()) {
+            return false;
+        }
+        *open() = std::forward<T>(value);
+        return true;
+    }
+
+    utils::dict_t& root_;
+    std::vector<frame> stack_;
+    std::string key_;
+    bool is_object_ = false;
+};
 
 namespace utils {
     inline void save_to_json(std::ostream& os, dict_t const& dict) {
-        os << json_from_dict(dict);
+        json_write_dict(os, dict);
     }
 
+    // Keys already in dict keep their values, like with put and
+    // json_to_dict; within the document a duplicate key replaces the
+    // earlier value.
     inline bool load_from_json(std::istream& is, dict_t& dict) {
-        json obj = json::parse(is);
-        if (!obj.is_object()) {
-            return false;
+        if (!dict.empty()) {
+            dict_t loaded(dict.get_allocator().resource());
+            bool const result = load_from_json(is, loaded);
+            merge(dict, std::move(loaded));
+            return result;
         }
-        json_to_dict(obj, dict);
-        return true;
+        dict_sax_handler handler(dict);
+        json::sax_parse(is, &handler);
+        return handler.is_object();
     }
 }
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "dict.hpp"
+#include "direct_serialization.hpp"
+
+// Lazy JSON loading: the input is kept in memory, objects and arrays are
+// stored as lazy_value ranges of it and parsed into dict_t or array_t the
+// first time they are read. Scalars next to them are parsed right away.
+
+namespace utils {
+    typedef std::shared_ptr<std::string const> json_buffer;
+
+    inline whatever lazy_json_value(json_reader& reader, json_buffer const& buffer,
+        std::pmr::memory_resource* resource);
+
+    // A duplicate key replaces the earlier value, like in load_from_json.
+    inline void lazy_json_dict(json_reader& reader, json_buffer const& buffer, dict_t& dict) {
+        std::string key_buffer;
+        std::string_view key;
+        reader.begin_dict();
+        while (reader.next_key(key_buffer, key)) {
+            auto [it, inserted] = dict.try_emplace(key);
+            it->second = lazy_json_value(reader, buffer, dict.get_allocator().resource());
+        }
+    }
+
+    // Objects and arrays are skipped over, which also checks their syntax,
+    // and kept as a range of the buffer.
+    inline whatever lazy_json_value(json_reader& reader, json_buffer const& buffer,
+            std::pmr::memory_resource* resource) {
+        char const c = reader.peek();
+        if (c == '{' || c == '[') {
+            char const* begin = reader.position();
+            reader.skip_value();
+            char const* end = reader.position();
+            // The value is built in the resource of the lazy_value computing
+            // it, which copies into another resource do not share.
+            auto make = [buffer, begin, end, c](std::pmr::memory_resource* target) {
+                json_reader nested(begin, end);
+                if (c == '{') {
+                    dict_t dict(target);
+                    lazy_json_dict(nested, buffer, dict);
+                    return whatever(std::allocator_arg, target, std::move(dict));
+                }
+                array_t array(target);
+                nested.begin_array();
+                while (nested.next_item()) {
+                    array.push_back(lazy_json_value(nested, buffer, target));
+                }
+                return whatever(std::allocator_arg, target, std::move(array));
+            };
+            return whatever(std::allocator_arg, resource, lazy_value(make, resource));
+        }
+        if (c == '"') {
+            std::string tmp;
+            return whatever(std::allocator_arg, resource, std::string(reader.string(tmp)));
+        }
+        if (c == 't' || c == 'f') {
+            return whatever(std::allocator_arg, resource, reader.boolean());
+        }
+        if (reader.null()) {
+            return whatever(std::allocator_arg, resource);
+        }
+        if (reader.next_is_integer()) {
+            return integer_value(reader.number<long long>(), resource);
+        }
+        return whatever(std::allocator_arg, resource, reader.number<double>());
+    }
+
+    // Reads the whole input once to index the top-level keys and check the
+    // syntax, but builds only the top-level entries. Returns false if the
+    // input is not a valid JSON object. Keys already in dict keep their
+    // values, like with load_from_json.
+    inline bool load_from_json_lazy(std::istream& is, dict_t& dict) {
+        if (!dict.empty()) {
+            dict_t loaded(dict.get_allocator().resource());
+            bool const result = load_from_json_lazy(is, loaded);
+            merge(dict, std::move(loaded));
+            return result;
+        }
+        auto buffer = std::make_shared<std::string const>(
+            (std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        json_reader reader(buffer->data(), buffer->data() + buffer->size());
+        try {
+            if (reader.peek() != '{') {
+                return false;
+            }
+            lazy_json_dict(reader, buffer, dict);
+            reader.finish();
+        } catch (invalid_format_exception const&) {
+            return false;
+        } catch (invalid_type_exception const&) {
+            return false;
+        }
+        return true;
+    }
+}
@@ -2,73 +2,262 @@
 
 #include "dict.hpp"
 
+#include <limits>
 #include <map>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace utils {
     template<typename T>
-    void write(dict_t& dict, std::vector<T> const& obj) {
-        size_t id = 0;
-        if constexpr (std::is_arithmetic_v<T> || std::is_same_v<T, std::string>) {
-            for (T const& value : obj) {
-                put(dict, std::to_string(id), value);
-                ++id;
+    inline constexpr bool is_plain_v = std::is_arithmetic_v<T> || std::is_same_v<T, std::string>;
+
+    // A data member of Class together with the key it is stored under.
+    template<typename Class, typename Member>
+    struct field_t {
+        std::string_view name;
+        Member Class::* member;
+    };
+
+    template<typename Class, typename Member>
+    constexpr field_t<Class, Member> field(std::string_view name, Member Class::* member) {
+        return {name, member};
+    }
+
+    // A user type opts in to serialization by listing its fields:
+    //     static constexpr auto fields() {
+    //         return std::make_tuple(utils::field("x", &point::x), utils::field("y", &point::y));
+    //     }
+    template<typename T, typename = void>
+    struct has_fields : std::false_type {};
+
+    template<typename T>
+    struct has_fields<T, std::void_t<decltype(T::fields())>> : std::true_type {};
+
+    template<typename T>
+    inline constexpr bool has_fields_v = has_fields<T>::value;
+
+    template<typename T, typename F>
+    void for_each_field(F&& f) {
+        std::apply([&f](auto const&... fields) {
+            (f(fields), ...);
+        }, T::fields());
+    }
+
+    // Converts a number as loaded from JSON or binary, where integers are int
+    // and the rest double, to T. Integers must fit into T, integral T is not
+    // read from floating point, and bool only from bool.
+    template<typename T, typename U>
+    bool convert_number(U const& src, T& obj) {
+        if constexpr (std::is_same_v<T, bool> || std::is_same_v<U, bool>) {
+            if constexpr (std::is_same_v<T, U>) {
+                obj = src;
+                return true;
+            } else {
+                return false;
             }
+        } else if constexpr (std::is_floating_point_v<T>) {
+            obj = static_cast<T>(src);
+            return true;
+        } else if constexpr (std::is_floating_point_v<U>) {
+            return false;
         } else {
-            for (T const& value : obj) {
-                dict_t tmp;
-                write(tmp, value);
-                put(dict, std::to_string(id), tmp);
-                ++id;
+            T const result = static_cast<T>(src);
+            bool same_sign = true;
+            if constexpr (std::is_signed_v<U> && !std::is_signed_v<T>) {
+                same_sign = (src >= 0);
+            } else if constexpr (!std::is_signed_v<U> && std::is_signed_v<T>) {
+                same_sign = (result >= 0);
+            }
+            if (!same_sign || static_cast<U>(result) != src) {
+                return false;
             }
+            obj = result;
+            return true;
         }
     }
 
+    template<typename T> void write_value(whatever& value, T const& obj);
+    template<typename T> void read_value(whatever const& value, T& obj);
+
+    // dict_t has string keys only, so a top-level vector keeps its elements
+    // under index keys; vectors nested anywhere below are stored as arrays.
+    // Keys already present in the dict keep their values, like with put.
     template<typename T>
-    void write(dict_t& dict, std::map<std::string, T> const& obj) {
-        if constexpr (std::is_arithmetic_v<T> || std::is_same_v<T, std::string>) {
-            for (auto const& [key, value] : obj) {
-                put(dict, std::string(key), value);
+    void write(dict_t& dict, std::vector<T> const& obj) {
+        dict.reserve(dict.size() + obj.size());
+        for (size_t id = 0; id < obj.size(); ++id) {
+            auto [it, inserted] = dict.try_emplace(std::to_string(id));
+            if (inserted) {
+                write_value(it->second, obj[id]);
             }
-        } else {
-            for (auto const& [key, value] : obj) {
-                dict_t tmp;
-                write(tmp, value);
-                put(dict, std::string(key), tmp);
+        }
+    }
+
+    template<typename T>
+    void write(dict_t& dict, std::map<std::string, T> const& obj) {
+        dict.reserve(dict.size() + obj.size());
+        for (auto const& [key, value] : obj) {
+            auto [it, inserted] = dict.try_emplace(key);
+            if (inserted) {
+                write_value(it->second, value);
             }
         }
     }
 
+    template<typename T>
+    std::enable_if_t<has_fields_v<T>> write(dict_t& dict, T const& obj) {
+        for_each_field<T>([&](auto const& field) {
+            auto [it, inserted] = dict.try_emplace(field.name);
+            if (inserted) {
+                write_value(it->second, obj.*field.member);
+            }
+        });
+    }
+
     template<typename T>
     void read(dict_t const& dict, std::vector<T>& obj) {
         obj.reserve(dict.size());
-        if constexpr (std::is_arithmetic_v<T> || std::is_same_v<T, std::string>) {
-            for (size_t id = 0; id < dict.size(); ++id) {
-                obj.push_back(get<T>(dict, std::to_string(id)));
-            }
-        } else {
-            for (size_t id = 0; id < dict.size(); ++id) {
-                T tmp;
-                read(get<dict_t>(dict, std::to_string(id)), tmp);
-                obj.push_back(tmp);
+        for (size_t id = 0; id < dict.size(); ++id) {
+            auto it = dict.find(std::to_string(id));
+            if (it == dict.end()) {
+                throw no_key_exception();
             }
+            T tmp;
+            read_value(it->second, tmp);
+            obj.push_back(std::move(tmp));
         }
     }
 
     template<typename T>
     void read(dict_t const& dict, std::map<std::string, T>& obj) {
-        if constexpr (std::is_arithmetic_v<T> || std::is_same_v<T, std::string>) {
-            for (auto const& [key, value] : dict) {
-                obj.insert(std::make_pair(key, get<T>(dict, key)));
+        for (auto const& [key, value] : dict) {
+            T tmp;
+            read_value(value, tmp);
+            obj.emplace(key, std::move(tmp));
+        }
+    }
+
+    template<typename T>
+    std::enable_if_t<has_fields_v<T>> read(dict_t const& dict, T& obj) {
+        for_each_field<T>([&](auto const& field) {
+            auto it = dict.find(field.name);
+            if (it == dict.end()) {
+                throw no_key_exception();
+            }
+            read_value(it->second, obj.*field.member);
+        });
+    }
+
+    // Vectors of arithmetic types or strings are stored as the vector itself,
+    // other vectors as array_t, maps and user types as a nested dict_t. The
+    // holders, dicts and arrays are built in the memory resource of value;
+    // the buffers of strings and plain vectors come from the global heap,
+    // see whatever.
+    template<typename T>
+    void write_value(whatever& value, T const& obj) {
+        if constexpr (is_plain_v<T>) {
+            value = obj;
+        } else if constexpr (is_vector_v<T>) {
+            if constexpr (is_plain_v<typename T::value_type>) {
+                value = obj;
+            } else {
+                array_t array(obj.size(), array_t::allocator_type(value.get_allocator()));
+                for (size_t i = 0; i < obj.size(); ++i) {
+                    write_value(array[i], obj[i]);
+                }
+                value = std::move(array);
+            }
+        } else {
+            dict_t tmp(value.get_allocator().resource());
+            write(tmp, obj);
+            value = std::move(tmp);
+        }
+    }
+
+    // Vectors are read from either representation, array_t as loaded from JSON
+    // or a vector of plain values as stored by write_value or loaded from
+    // binary. Numbers of another type are converted by convert_number, and
+    // null, which is how JSON stores non-finite numbers, reads as NaN into
+    // floating point, like in the direct decoders. Lazy values are computed
+    // first.
+    template<typename T>
+    void read_value(whatever const& raw, T& obj) {
+        whatever const& value = resolve(raw);
+        if constexpr (std::is_floating_point_v<T>) {
+            if (value.empty()) {
+                obj = std::numeric_limits<T>::quiet_NaN();
+                return;
+            }
+        }
+        if constexpr (std::is_arithmetic_v<T>) {
+            bool converted = false;
+            value.visit<bool, char, short, int, long, unsigned char, unsigned short, unsigned int,
+                    unsigned long, float, double>([&](auto const& src) {
+                converted = convert_number(src, obj);
+            });
+            if (!converted) {
+                throw invalid_type_exception();
+            }
+        } else if constexpr (is_plain_v<T>) {
+            T const* ptr = whatever_cast<T>(&value);
+            if (ptr == nullptr) {
+                throw invalid_type_exception();
+            }
+            obj = *ptr;
+        } else if constexpr (is_vector_v<T>) {
+            typedef typename T::value_type item_type;
+            if constexpr (is_plain_v<item_type>) {
+                if (T const* ptr = whatever_cast<T>(&value)) {
+                    obj = *ptr;
+                    return;
+                }
+            }
+            if constexpr (std::is_arithmetic_v<item_type>) {
+                bool converted = true;
+                bool const is_vector = value.visit<std::vector<bool>, std::vector<char>, std::vector<short>,
+                        std::vector<int>, std::vector<long>, std::vector<unsigned char>, std::vector<unsigned short>,
+                        std::vector<unsigned int>, std::vector<unsigned long>, std::vector<float>,
+                        std::vector<double>>([&](auto const& src) {
+                    typedef typename std::decay_t<decltype(src)>::value_type src_type;
+                    obj.clear();
+                    obj.reserve(src.size());
+                    for (src_type item : src) {
+                        item_type tmp = item_type();
+                        if (!convert_number(item, tmp)) {
+                            converted = false;
+                            return;
+                        }
+                        obj.push_back(tmp);
+                    }
+                });
+                if (is_vector) {
+                    if (!converted) {
+                        throw invalid_type_exception();
+                    }
+                    return;
+                }
+            }
+            array_t const* array = whatever_cast<array_t>(&value);
+            if (array == nullptr) {
+                throw invalid_type_exception();
+            }
+            obj.clear();
+            obj.reserve(array->size());
+            for (auto const& item : *array) {
+                typename T::value_type tmp;
+                read_value(item, tmp);
+                obj.push_back(std::move(tmp));
             }
         } else {
-            for (auto const& [key, value] : dict) {
-                T tmp;
-                read(get<dict_t>(dict, key), tmp);
-                obj.insert(std::make_pair(key, tmp));
+            dict_t const* nested = whatever_cast<dict_t>(&value);
+            if (nested == nullptr) {
+                throw invalid_type_exception();
             }
+            read(*nested, obj);
         }
     }
 }
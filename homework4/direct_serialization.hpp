@@ -0,0 +1,683 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dict_binary.hpp"
+#include "dict_json.hpp"
+#include "dict_serialization.hpp"
+
+// Serializes vectors, maps, plain values and user types with fields()
+// straight to JSON or the binary format and back, without building a dict_t.
+// The output is the same document the dict_t path produces for the same
+// value, so either path can read what the other wrote.
+
+namespace utils {
+    template<typename T>
+    struct is_string_map : std::false_type {};
+
+    template<typename T, typename Compare, typename Allocator>
+    struct is_string_map<std::map<std::string, T, Compare, Allocator>> : std::true_type {};
+
+    template<typename T>
+    inline constexpr bool is_string_map_v = is_string_map<T>::value;
+
+    // Writes the same events as binary_writer as compact JSON text.
+    class json_writer {
+    public:
+        explicit json_writer(std::ostream& os) : os_(os) {}
+
+        void key(std::string_view key) {
+            separate();
+            json_write_string(os_, key);
+            os_.put(':');
+            after_key_ = true;
+        }
+
+        void null() {
+            separate();
+            os_.write("null", 4);
+        }
+
+        void boolean(bool value) {
+            separate();
+            json_write(os_, value);
+        }
+
+        void integer(int64_t value) {
+            separate();
+            json_write_int(os_, value);
+        }
+
+        void number(double value) {
+            separate();
+            json_write_double(os_, value);
+        }
+
+        void string(std::string_view value) {
+            separate();
+            json_write_string(os_, value);
+        }
+
+        template<typename T>
+        void numbers(T const* data, size_t count) {
+            begin_array();
+            for (size_t i = 0; i < count; ++i) {
+                if constexpr (std::is_integral_v<T>) {
+                    integer(static_cast<int64_t>(data[i]));
+                } else {
+                    number(static_cast<double>(data[i]));
+                }
+            }
+            end_array();
+        }
+
+        void begin_dict() {
+            separate();
+            os_.put('{');
+            first_ = true;
+        }
+
+        void end_dict() {
+            os_.put('}');
+            first_ = false;
+        }
+
+        void begin_array() {
+            separate();
+            os_.put('[');
+            first_ = true;
+        }
+
+        void end_array() {
+            os_.put(']');
+            first_ = false;
+        }
+
+    private:
+        // A value right after its key needs no comma, any other item does
+        // unless it is the first one in its container.
+        void separate() {
+            if (after_key_) {
+                after_key_ = false;
+            } else if (!first_) {
+                os_.put(',');
+            }
+            first_ = false;
+        }
+
+        std::ostream& os_;
+        bool first_ = true;
+        bool after_key_ = false;
+    };
+
+    // Pull parser over a JSON text in memory. Unescaped strings and keys are
+    // returned as views into the input.
+    class json_reader {
+    public:
+        json_reader(char const* begin, char const* end) : pos_(begin), end_(end) {}
+
+        bool null() {
+            if (peek() != 'n') {
+                return false;
+            }
+            literal("null");
+            return true;
+        }
+
+        bool boolean() {
+            char c = peek();
+            if (c == 't') {
+                literal("true");
+                return true;
+            }
+            if (c == 'f') {
+                literal("false");
+                return false;
+            }
+            throw invalid_type_exception();
+        }
+
+        // Integers must not have a fraction or exponent and must fit in T.
+        template<typename T>
+        T number() {
+            char c = peek();
+            if (c != '-' && (c < '0' || c > '9')) {
+                throw invalid_type_exception();
+            }
+            char const* begin = pos_;
+            while (pos_ != end_ && (is_digit(*pos_) || *pos_ == '-' || *pos_ == '+'
+                    || *pos_ == '.' || *pos_ == 'e' || *pos_ == 'E')) {
+                ++pos_;
+            }
+            T result{};
+            auto [ptr, error] = std::from_chars(begin, pos_, result);
+            if (error == std::errc::result_out_of_range) {
+                throw invalid_type_exception();
+            }
+            if (error != std::errc() || ptr != pos_) {
+                if constexpr (std::is_integral_v<T>) {
+                    throw invalid_type_exception();
+                } else {
+                    throw invalid_format_exception();
+                }
+            }
+            return result;
+        }
+
+        std::string_view string(std::string& buffer) {
+            if (peek() != '"') {
+                throw invalid_type_exception();
+            }
+            ++pos_;
+            char const* begin = pos_;
+            while (pos_ != end_ && *pos_ != '"' && *pos_ != '\\') {
+                ++pos_;
+            }
+            if (pos_ == end_) {
+                throw invalid_format_exception();
+            }
+            if (*pos_ == '"') {
+                return std::string_view(begin, pos_++ - begin);
+            }
+            buffer.assign(begin, pos_);
+            while (true) {
+                if (pos_ == end_) {
+                    throw invalid_format_exception();
+                }
+                char c = *pos_++;
+                if (c == '"') {
+                    return buffer;
+                }
+                if (c == '\\') {
+                    unescape(buffer);
+                } else {
+                    buffer.push_back(c);
+                }
+            }
+        }
+
+        void begin_dict() {
+            expect('{');
+        }
+
+        // Reads the next key of the current dict, or returns false at its end.
+        bool next_key(std::string& buffer, std::string_view& key) {
+            if (!next('}')) {
+                return false;
+            }
+            if (peek() != '"') {
+                throw invalid_format_exception();
+            }
+            key = string(buffer);
+            expect(':');
+            return true;
+        }
+
+        void begin_array() {
+            expect('[');
+        }
+
+        bool next_item() {
+            return next(']');
+        }
+
+        // Skips one value of any type. Nesting is limited to MAX_DEPTH levels
+        // so that hostile input cannot exhaust the stack.
+        void skip_value(size_t depth = 0) {
+            if (depth == MAX_DEPTH) {
+                throw invalid_format_exception();
+            }
+            std::string buffer;
+            std::string_view key;
+            switch (peek()) {
+                case '{':
+                    begin_dict();
+                    while (next_key(buffer, key)) {
+                        skip_value(depth + 1);
+                    }
+                    break;
+                case '[':
+                    begin_array();
+                    while (next_item()) {
+                        skip_value(depth + 1);
+                    }
+                    break;
+                case '"':
+                    string(buffer);
+                    break;
+                case 't': case 'f':
+                    boolean();
+                    break;
+                case 'n':
+                    null();
+                    break;
+                default:
+                    number<double>();
+            }
+        }
+
+        char peek() {
+            skip_whitespace();
+            if (pos_ == end_) {
+                throw invalid_format_exception();
+            }
+            return *pos_;
+        }
+
+        // Start of the next value, for callers that keep raw ranges of input.
+        char const* position() {
+            skip_whitespace();
+            return pos_;
+        }
+
+        // Whether the next number has neither a fraction nor an exponent.
+        bool next_is_integer() {
+            char const* it = position();
+            while (it != end_ && (is_digit(*it) || *it == '-')) {
+                ++it;
+            }
+            return it == end_ || (*it != '.' && *it != 'e' && *it != 'E');
+        }
+
+        // Only whitespace may follow the top-level value.
+        void finish() {
+            skip_whitespace();
+            if (pos_ != end_) {
+                throw invalid_format_exception();
+            }
+        }
+
+    private:
+        static constexpr size_t MAX_DEPTH = 512;
+
+        static bool is_digit(char c) {
+            return c >= '0' && c <= '9';
+        }
+
+        void skip_whitespace() {
+            while (pos_ != end_ && (*pos_ == ' ' || *pos_ == '\n' || *pos_ == '\r' || *pos_ == '\t')) {
+                ++pos_;
+            }
+        }
+
+        // A missing bracket means a value of another type, anything else is a
+        // syntax error.
+        void expect(char c) {
+            if (peek() != c) {
+                if (c == '{' || c == '[') {
+                    throw invalid_type_exception();
+                }
+                throw invalid_format_exception();
+            }
+            ++pos_;
+            opened_ = (c == '{' || c == '[');
+        }
+
+        void literal(std::string_view word) {
+            if (static_cast<size_t>(end_ - pos_) < word.size() || std::string_view(pos_, word.size()) != word) {
+                throw invalid_format_exception();
+            }
+            pos_ += word.size();
+        }
+
+        // Consumes the separator before the next item, or the closing bracket.
+        bool next(char close) {
+            bool const opened = opened_;
+            opened_ = false;
+            if (peek() == close) {
+                ++pos_;
+                return false;
+            }
+            if (!opened) {
+                expect(',');
+            }
+            if (peek() == ',' || peek() == close) {
+                throw invalid_format_exception();
+            }
+            return true;
+        }
+
+        uint32_t hex4() {
+            if (end_ - pos_ < 4) {
+                throw invalid_format_exception();
+            }
+            uint32_t result = 0;
+            for (int i = 0; i < 4; ++i) {
+                char c = *pos_++;
+                result <<= 4;
+                if (c >= '0' && c <= '9') {
+                    result |= c - '0';
+                } else if (c >= 'a' && c <= 'f') {
+                    result |= c - 'a' + 10;
+                } else if (c >= 'A' && c <= 'F') {
+                    result |= c - 'A' + 10;
+                } else {
+                    throw invalid_format_exception();
+                }
+            }
+            return result;
+        }
+
+        void unescape(std::string& buffer) {
+            if (pos_ == end_) {
+                throw invalid_format_exception();
+            }
+            switch (char c = *pos_++) {
+                case '"': case '\\': case '/': buffer.push_back(c); return;
+                case 'b': buffer.push_back('\b'); return;
+                case 'f': buffer.push_back('\f'); return;
+                case 'n': buffer.push_back('\n'); return;
+                case 'r': buffer.push_back('\r'); return;
+                case 't': buffer.push_back('\t'); return;
+                case 'u': break;
+                default: throw invalid_format_exception();
+            }
+            uint32_t code = hex4();
+            if (code >= 0xd800 && code < 0xdc00) {
+                literal("\\u");
+                uint32_t low = hex4();
+                if (low < 0xdc00 || low >= 0xe000) {
+                    throw invalid_format_exception();
+                }
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+            }
+            if (code < 0x80) {
+                buffer.push_back(static_cast<char>(code));
+            } else if (code < 0x800) {
+                buffer.push_back(static_cast<char>(0xc0 | (code >> 6)));
+                buffer.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+            } else if (code < 0x10000) {
+                buffer.push_back(static_cast<char>(0xe0 | (code >> 12)));
+                buffer.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+                buffer.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+            } else {
+                buffer.push_back(static_cast<char>(0xf0 | (code >> 18)));
+                buffer.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3f)));
+                buffer.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+                buffer.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+            }
+        }
+
+        char const* pos_;
+        char const* end_;
+        bool opened_ = false;
+    };
+
+    // Emits obj as events to a json_writer or binary_writer. Plain vectors go
+    // through numbers() so the binary format packs them.
+    template<typename Writer, typename T>
+    void encode(Writer& writer, T const& obj) {
+        if constexpr (std::is_same_v<T, bool>) {
+            writer.boolean(obj);
+        } else if constexpr (std::is_integral_v<T>) {
+            writer.integer(static_cast<int64_t>(obj));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            writer.number(obj);
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            writer.string(obj);
+        } else if constexpr (is_vector_v<T>) {
+            typedef typename T::value_type value_type;
+            if constexpr (std::is_arithmetic_v<value_type> && !std::is_same_v<value_type, bool>) {
+                writer.numbers(obj.data(), obj.size());
+            } else {
+                writer.begin_array();
+                for (auto const& item : obj) {
+                    encode(writer, static_cast<value_type const&>(item));
+                }
+                writer.end_array();
+            }
+        } else if constexpr (is_string_map_v<T>) {
+            writer.begin_dict();
+            for (auto const& [key, value] : obj) {
+                writer.key(key);
+                encode(writer, value);
+            }
+            writer.end_dict();
+        } else {
+            static_assert(has_fields_v<T>, "Type is not serializable, declare its fields().");
+            writer.begin_dict();
+            for_each_field<T>([&](auto const& field) {
+                writer.key(field.name);
+                encode(writer, obj.*field.member);
+            });
+            writer.end_dict();
+        }
+    }
+
+    // Like write(dict_t&, vector), a top-level vector is a dict of index keys.
+    template<typename Writer, typename T>
+    void encode_document(Writer& writer, T const& obj) {
+        if constexpr (is_vector_v<T>) {
+            writer.begin_dict();
+            for (size_t id = 0; id < obj.size(); ++id) {
+                writer.key(std::to_string(id));
+                encode(writer, static_cast<typename T::value_type const&>(obj[id]));
+            }
+            writer.end_dict();
+        } else {
+            static_assert(is_string_map_v<T> || has_fields_v<T>, "A document must be a vector, a map or a user type.");
+            encode(writer, obj);
+        }
+    }
+
+    template<typename T>
+    void decode(json_reader& reader, T& obj) {
+        if constexpr (std::is_same_v<T, bool>) {
+            obj = reader.boolean();
+        } else if constexpr (std::is_floating_point_v<T>) {
+            obj = (reader.null() ? std::numeric_limits<T>::quiet_NaN() : reader.template number<T>());
+        } else if constexpr (std::is_arithmetic_v<T>) {
+            obj = reader.template number<T>();
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            std::string buffer;
+            obj = reader.string(buffer);
+        } else if constexpr (is_vector_v<T>) {
+            obj.clear();
+            reader.begin_array();
+            while (reader.next_item()) {
+                typename T::value_type tmp;
+                decode(reader, tmp);
+                obj.push_back(std::move(tmp));
+            }
+        } else if constexpr (is_string_map_v<T>) {
+            std::string buffer;
+            std::string_view key;
+            reader.begin_dict();
+            while (reader.next_key(buffer, key)) {
+                typename T::mapped_type tmp;
+                decode(reader, tmp);
+                obj.emplace(std::string(key), std::move(tmp));
+            }
+        } else {
+            static_assert(has_fields_v<T>, "Type is not serializable, declare its fields().");
+            std::array<bool, std::tuple_size_v<decltype(T::fields())>> seen{};
+            std::string buffer;
+            std::string_view key;
+            reader.begin_dict();
+            while (reader.next_key(buffer, key)) {
+                bool found = false;
+                size_t id = 0;
+                for_each_field<T>([&](auto const& field) {
+                    if (!found && field.name == key) {
+                        decode(reader, obj.*field.member);
+                        found = seen[id] = true;
+                    }
+                    ++id;
+                });
+                if (!found) {
+                    reader.skip_value();
+                }
+            }
+            for (bool is_seen : seen) {
+                if (!is_seen) {
+                    throw no_key_exception();
+                }
+            }
+        }
+    }
+
+    template<typename T>
+    void decode(binary_value const& value, T& obj) {
+        if constexpr (std::is_same_v<T, bool>) {
+            obj = value.as_bool();
+        } else if constexpr (std::is_floating_point_v<T>) {
+            if (value.is_null()) {
+                obj = std::numeric_limits<T>::quiet_NaN();
+            } else {
+                obj = static_cast<T>(value.type() == binary_type::integer ? value.as_int() : value.as_double());
+            }
+        } else if constexpr (std::is_arithmetic_v<T>) {
+            if (!convert_number(value.as_int(), obj)) {
+                throw invalid_type_exception();
+            }
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            obj = value.as_string();
+        } else if constexpr (is_vector_v<T>) {
+            binary_array array = value.as_array();
+            obj.clear();
+            obj.reserve(array.size());
+            for (size_t i = 0; i < array.size(); ++i) {
+                typename T::value_type tmp;
+                decode(array[i], tmp);
+                obj.push_back(std::move(tmp));
+            }
+        } else {
+            decode(value.as_dict(), obj);
+        }
+    }
+
+    template<typename T>
+    void decode(binary_dict const& dict, T& obj) {
+        if constexpr (is_string_map_v<T>) {
+            for (size_t i = 0; i < dict.size(); ++i) {
+                typename T::mapped_type tmp;
+                decode(dict.value(i), tmp);
+                obj.emplace(std::string(dict.key(i)), std::move(tmp));
+            }
+        } else {
+            static_assert(has_fields_v<T>, "Type is not serializable, declare its fields().");
+            for_each_field<T>([&](auto const& field) {
+                std::optional<binary_value> item = dict.find(field.name);
+                if (!item) {
+                    throw no_key_exception();
+                }
+                decode(*item, obj.*field.member);
+            });
+        }
+    }
+
+    // Index keys of a top-level vector may come in any order, as dict_t
+    // writes them in hash order, so they are checked once all are read. An
+    // index of a dense vector is below the number of entries, which bounds
+    // the memory an index can ask for.
+    template<typename T>
+    void decode_document(json_reader& reader, T& obj) {
+        if constexpr (is_vector_v<T>) {
+            std::vector<std::pair<size_t, typename T::value_type>> items;
+            std::string buffer;
+            std::string_view key;
+            reader.begin_dict();
+            while (reader.next_key(buffer, key)) {
+                size_t id = 0;
+                auto [ptr, error] = std::from_chars(key.data(), key.data() + key.size(), id);
+                if (error != std::errc() || ptr != key.data() + key.size()) {
+                    throw no_key_exception();
+                }
+                typename T::value_type tmp;
+                decode(reader, tmp);
+                items.emplace_back(id, std::move(tmp));
+            }
+            size_t size = 0;
+            for (auto const& item : items) {
+                if (item.first >= items.size()) {
+                    throw no_key_exception();
+                }
+                size = std::max(size, item.first + 1);
+            }
+            std::vector<bool> seen(size);
+            obj.clear();
+            obj.resize(size);
+            for (auto& [id, value] : items) {
+                obj[id] = std::move(value);
+                seen[id] = true;
+            }
+            for (bool is_seen : seen) {
+                if (!is_seen) {
+                    throw no_key_exception();
+                }
+            }
+        } else {
+            decode(reader, obj);
+        }
+    }
+
+    template<typename T>
+    void decode_document(binary_dict const& dict, T& obj) {
+        if constexpr (is_vector_v<T>) {
+            obj.clear();
+            obj.reserve(dict.size());
+            for (size_t id = 0; id < dict.size(); ++id) {
+                std::optional<binary_value> item = dict.find(std::to_string(id));
+                if (!item) {
+                    throw no_key_exception();
+                }
+                typename T::value_type tmp;
+                decode(*item, tmp);
+                obj.push_back(std::move(tmp));
+            }
+        } else {
+            decode(dict, obj);
+        }
+    }
+
+    template<typename T>
+    void save_to_json(std::ostream& os, T const& obj) {
+        json_writer writer(os);
+        encode_document(writer, obj);
+    }
+
+    template<typename T>
+    void save_to_binary(std::ostream& os, T const& obj) {
+        binary_writer writer;
+        encode_document(writer, obj);
+        os.write(writer.buffer().data(), writer.buffer().size());
+    }
+
+    // Both return false on malformed input and throw no_key_exception or
+    // invalid_type_exception if the document does not match T.
+    template<typename T>
+    bool load_from_json(std::istream& is, T& obj) {
+        std::string buffer((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        json_reader reader(buffer.data(), buffer.data() + buffer.size());
+        try {
+            decode_document(reader, obj);
+            reader.finish();
+        } catch (invalid_format_exception const&) {
+            return false;
+        }
+        return true;
+    }
+
+    template<typename T>
+    bool load_from_binary(std::istream& is, T& obj) {
+        std::string buffer((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        try {
+            decode_document(binary_view(buffer.data(), buffer.size()).root(), obj);
+        } catch (invalid_format_exception const&) {
+            return false;
+        }
+        return true;
+    }
+}
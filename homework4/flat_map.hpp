@@ -0,0 +1,521 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace utils {
+    // Open-addressing hash map from string keys. Entries live in one
+    // contiguous slot array next to an array of control bytes (empty, deleted
+    // or the low 7 bits of the hash), probed linearly. Lookups take
+    // std::string_view and never allocate.
+    //
+    // Memory comes from a std::pmr resource, which is passed on to the keys
+    // and to allocator-aware values, with the usual std::pmr container rules.
+    //
+    // Unlike std::unordered_map, entries move when the map grows: an
+    // insertion may invalidate every iterator, pointer and reference into
+    // the map. The arguments of try_emplace may still refer into it.
+    template<typename T>
+    struct flat_map {
+    public:
+        typedef std::pmr::string key_type;
+        typedef T mapped_type;
+        typedef std::pair<std::pmr::string const, T> value_type;
+        typedef std::pmr::polymorphic_allocator<value_type> allocator_type;
+
+        template<bool Const>
+        struct basic_iterator {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef typename flat_map::value_type value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef std::conditional_t<Const, value_type const*, value_type*> pointer;
+            typedef std::conditional_t<Const, value_type const&, value_type&> reference;
+
+            basic_iterator() = default;
+            basic_iterator(int8_t const* ctrl, int8_t const* ctrl_end, pointer slot)
+                : ctrl_(ctrl), ctrl_end_(ctrl_end), slot_(slot) {}
+            operator basic_iterator<true>() const {
+                return basic_iterator<true>(ctrl_, ctrl_end_, slot_);
+            }
+
+            reference operator*() const {
+                return *slot_;
+            }
+
+            pointer operator->() const {
+                return slot_;
+            }
+
+            basic_iterator& operator++() {
+                ++ctrl_;
+                ++slot_;
+                skip_free();
+                return *this;
+            }
+
+            basic_iterator operator++(int) {
+                basic_iterator result = *this;
+                ++(*this);
+                return result;
+            }
+
+            friend bool operator==(basic_iterator const& lhs, basic_iterator const& rhs) {
+                return lhs.ctrl_ == rhs.ctrl_;
+            }
+
+            friend bool operator!=(basic_iterator const& lhs, basic_iterator const& rhs) {
+                return lhs.ctrl_ != rhs.ctrl_;
+            }
+
+        private:
+            friend struct flat_map;
+
+            void skip_free() {
+                while (ctrl_ != ctrl_end_ && *ctrl_ < 0) {
+                    ++ctrl_;
+                    ++slot_;
+                }
+            }
+
+            int8_t const* ctrl_ = nullptr;
+            int8_t const* ctrl_end_ = nullptr;
+            pointer slot_ = nullptr;
+        };
+
+        typedef basic_iterator<false> iterator;
+        typedef basic_iterator<true> const_iterator;
+
+        flat_map() = default;
+        explicit flat_map(allocator_type const& allocator);
+        flat_map(std::initializer_list<value_type> list, allocator_type const& allocator = allocator_type());
+
+        flat_map(flat_map const& other);
+        flat_map(flat_map const& other, allocator_type const& allocator);
+        flat_map& operator=(flat_map const& other);
+
+        flat_map(flat_map&& other) noexcept;
+        flat_map(flat_map&& other, allocator_type const& allocator);
+        flat_map& operator=(flat_map&& other);
+
+        ~flat_map();
+
+        allocator_type get_allocator() const;
+
+        iterator begin();
+        iterator end();
+        const_iterator begin() const;
+        const_iterator end() const;
+
+        bool empty() const;
+        size_t size() const;
+        void clear();
+        void reserve(size_t count);
+        void swap(flat_map& other) noexcept;
+
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(std::string_view key, Args&&... args);
+
+        iterator find(std::string_view key);
+        const_iterator find(std::string_view key) const;
+        size_t erase(std::string_view key);
+
+        // Lookup with a hash computed beforehand by hash(key).
+        iterator find(std::string_view key, size_t hash);
+        const_iterator find(std::string_view key, size_t hash) const;
+        static size_t hash(std::string_view key);
+
+        template<typename U>
+        friend bool operator==(flat_map<U> const& lhs, flat_map<U> const& rhs);
+
+    private:
+        static constexpr int8_t EMPTY = -128;
+        static constexpr int8_t DELETED = -2;
+        static constexpr size_t MIN_CAPACITY = 8;
+
+        static int8_t control(size_t hash);
+
+        size_t find_index(std::string_view key, size_t hash) const;
+        size_t free_index(size_t hash) const;
+        size_t grown_capacity() const;
+        void allocate(size_t capacity);
+        void rehash(size_t capacity);
+        void move_entries_to(flat_map& result);
+        void destroy() noexcept;
+        iterator iterator_at(size_t index);
+
+        template<typename... Args>
+        void construct_at(size_t index, size_t hash, Args&&... args);
+
+        std::pmr::memory_resource* resource_ = std::pmr::get_default_resource();
+        int8_t* ctrl_ = nullptr;
+        value_type* slots_ = nullptr;
+        size_t capacity_ = 0;
+        size_t size_ = 0;
+        size_t deleted_ = 0;
+    };
+
+    template<typename T>
+    flat_map<T>::flat_map(allocator_type const& allocator) : resource_(allocator.resource()) {}
+
+    template<typename T>
+    flat_map<T>::flat_map(std::initializer_list<value_type> list, allocator_type const& allocator)
+            : resource_(allocator.resource()) {
+        reserve(list.size());
+        for (auto const& item : list) {
+            try_emplace(item.first, item.second);
+        }
+    }
+
+    // A copy uses the default resource unless one is given.
+    template<typename T>
+    flat_map<T>::flat_map(flat_map const& other) : flat_map(other, allocator_type()) {}
+
+    template<typename T>
+    flat_map<T>::flat_map(flat_map const& other, allocator_type const& allocator) : resource_(allocator.resource()) {
+        if (other.size_ == 0) {
+            return;
+        }
+        try {
+            reserve(other.size_);
+            for (auto const& item : other) {
+                construct_at(free_index(hash(item.first)), hash(item.first), item);
+            }
+        } catch (...) {
+            destroy();
+            throw;
+        }
+    }
+
+    template<typename T>
+    flat_map<T>& flat_map<T>::operator=(flat_map const& other) {
+        flat_map(other, resource_).swap(*this);
+        return *this;
+    }
+
+    template<typename T>
+    flat_map<T>::flat_map(flat_map&& other) noexcept : resource_(other.resource_) {
+        swap(other);
+    }
+
+    // Entries from another resource are moved one by one into ours.
+    template<typename T>
+    flat_map<T>::flat_map(flat_map&& other, allocator_type const& allocator) : resource_(allocator.resource()) {
+        if (*resource_ == *other.resource_) {
+            swap(other);
+            return;
+        }
+        try {
+            reserve(other.size_);
+            for (auto& item : other) {
+                construct_at(free_index(hash(item.first)), hash(item.first),
+                    std::piecewise_construct, std::forward_as_tuple(item.first),
+                    std::forward_as_tuple(std::move(item.second)));
+            }
+        } catch (...) {
+            destroy();
+            throw;
+        }
+        other.clear();
+    }
+
+    template<typename T>
+    flat_map<T>& flat_map<T>::operator=(flat_map&& other) {
+        flat_map(std::move(other), resource_).swap(*this);
+        return *this;
+    }
+
+    template<typename T>
+    flat_map<T>::~flat_map() {
+        destroy();
+    }
+
+    template<typename T>
+    typename flat_map<T>::allocator_type flat_map<T>::get_allocator() const {
+        return resource_;
+    }
+
+    template<typename T>
+    typename flat_map<T>::iterator flat_map<T>::begin() {
+        iterator it(ctrl_, ctrl_ + capacity_, slots_);
+        it.skip_free();
+        return it;
+    }
+
+    template<typename T>
+    typename flat_map<T>::iterator flat_map<T>::end() {
+        return iterator(ctrl_ + capacity_, ctrl_ + capacity_, slots_ + capacity_);
+    }
+
+    template<typename T>
+    typename flat_map<T>::const_iterator flat_map<T>::begin() const {
+        return const_cast<flat_map*>(this)->begin();
+    }
+
+    template<typename T>
+    typename flat_map<T>::const_iterator flat_map<T>::end() const {
+        return const_cast<flat_map*>(this)->end();
+    }
+
+    template<typename T>
+    bool flat_map<T>::empty() const {
+        return size_ == 0;
+    }
+
+    template<typename T>
+    size_t flat_map<T>::size() const {
+        return size_;
+    }
+
+    template<typename T>
+    void flat_map<T>::clear() {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (ctrl_[i] >= 0) {
+                slots_[i].~value_type();
+            }
+            ctrl_[i] = EMPTY;
+        }
+        size_ = 0;
+        deleted_ = 0;
+    }
+
+    // Keeps the load factor, tombstones included, at most 7/8.
+    template<typename T>
+    void flat_map<T>::reserve(size_t count) {
+        size_t capacity = MIN_CAPACITY;
+        while (capacity * 7 / 8 < count) {
+            capacity *= 2;
+        }
+        if (capacity > capacity_) {
+            rehash(capacity);
+        }
+    }
+
+    // Swaps the resources as well, which keeps every entry with the resource
+    // it was allocated from.
+    template<typename T>
+    void flat_map<T>::swap(flat_map& other) noexcept {
+        std::swap(resource_, other.resource_);
+        std::swap(ctrl_, other.ctrl_);
+        std::swap(slots_, other.slots_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(size_, other.size_);
+        std::swap(deleted_, other.deleted_);
+    }
+
+    template<typename T>
+    template<typename... Args>
+    std::pair<typename flat_map<T>::iterator, bool> flat_map<T>::try_emplace(std::string_view key, Args&&... args) {
+        size_t const key_hash = hash(key);
+        size_t index = find_index(key, key_hash);
+        if (index != capacity_) {
+            return {iterator_at(index), false};
+        }
+
+        if ((size_ + deleted_ + 1) > capacity_ * 7 / 8) {
+            // The new entry is built before the old ones are moved, since
+            // args may refer to one of them.
+            flat_map result(resource_);
+            result.allocate(grown_capacity());
+            index = result.free_index(key_hash);
+            result.construct_at(index, key_hash, std::piecewise_construct,
+                std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+            move_entries_to(result);
+            swap(result);
+            return {iterator_at(index), true};
+        }
+        index = free_index(key_hash);
+        if (ctrl_[index] == DELETED) {
+            --deleted_;
+        }
+        construct_at(index, key_hash, std::piecewise_construct,
+            std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        return {iterator_at(index), true};
+    }
+
+    template<typename T>
+    typename flat_map<T>::iterator flat_map<T>::find(std::string_view key) {
+        return find(key, hash(key));
+    }
+
+    template<typename T>
+    typename flat_map<T>::const_iterator flat_map<T>::find(std::string_view key) const {
+        return const_cast<flat_map*>(this)->find(key);
+    }
+
+    template<typename T>
+    typename flat_map<T>::iterator flat_map<T>::find(std::string_view key, size_t hash) {
+        size_t index = find_index(key, hash);
+        return (index == capacity_ ? end() : iterator_at(index));
+    }
+
+    template<typename T>
+    typename flat_map<T>::const_iterator flat_map<T>::find(std::string_view key, size_t hash) const {
+        return const_cast<flat_map*>(this)->find(key, hash);
+    }
+
+    template<typename T>
+    size_t flat_map<T>::erase(std::string_view key) {
+        size_t index = find_index(key, hash(key));
+        if (index == capacity_) {
+            return 0;
+        }
+        slots_[index].~value_type();
+        --size_;
+        // A slot followed by an empty one ends every probe sequence through it.
+        if (ctrl_[(index + 1) & (capacity_ - 1)] == EMPTY) {
+            ctrl_[index] = EMPTY;
+        } else {
+            ctrl_[index] = DELETED;
+            ++deleted_;
+        }
+        return 1;
+    }
+
+    template<typename T>
+    size_t flat_map<T>::hash(std::string_view key) {
+        return std::hash<std::string_view>()(key);
+    }
+
+    template<typename T>
+    int8_t flat_map<T>::control(size_t hash) {
+        return static_cast<int8_t>(hash & 0x7f);
+    }
+
+    template<typename T>
+    size_t flat_map<T>::find_index(std::string_view key, size_t hash) const {
+        if (capacity_ == 0) {
+            return capacity_;
+        }
+        size_t const mask = capacity_ - 1;
+        int8_t const h2 = control(hash);
+        for (size_t index = (hash >> 7) & mask; ; index = (index + 1) & mask) {
+            if (ctrl_[index] == EMPTY) {
+                return capacity_;
+            }
+            if (ctrl_[index] == h2 && slots_[index].first == key) {
+                return index;
+            }
+        }
+    }
+
+    template<typename T>
+    size_t flat_map<T>::free_index(size_t hash) const {
+        size_t const mask = capacity_ - 1;
+        size_t index = (hash >> 7) & mask;
+        while (ctrl_[index] >= 0) {
+            index = (index + 1) & mask;
+        }
+        return index;
+    }
+
+    // Doubles the capacity, or only drops the tombstones if they take up
+    // most of the room.
+    template<typename T>
+    size_t flat_map<T>::grown_capacity() const {
+        return (size_ + 1 > capacity_ * 7 / 16 ? std::max(MIN_CAPACITY, capacity_ * 2) : capacity_);
+    }
+
+    // Empty arrays for an empty map without any.
+    template<typename T>
+    void flat_map<T>::allocate(size_t capacity) {
+        ctrl_ = std::pmr::polymorphic_allocator<int8_t>(resource_).allocate(capacity);
+        std::fill(ctrl_, ctrl_ + capacity, EMPTY);
+        capacity_ = capacity;
+        slots_ = allocator_type(resource_).allocate(capacity);
+    }
+
+    template<typename T>
+    void flat_map<T>::rehash(size_t capacity) {
+        flat_map result(resource_);
+        result.allocate(capacity);
+        move_entries_to(result);
+        swap(result);
+    }
+
+    // The entries left behind are only destroyed, so their keys are moved
+    // from like the key of a node handle instead of being copied.
+    template<typename T>
+    void flat_map<T>::move_entries_to(flat_map& result) {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (ctrl_[i] < 0) {
+                continue;
+            }
+            key_type& key = const_cast<key_type&>(slots_[i].first);
+            size_t const key_hash = hash(key);
+            result.construct_at(result.free_index(key_hash), key_hash, std::piecewise_construct,
+                std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::move(slots_[i].second)));
+        }
+    }
+
+    template<typename T>
+    void flat_map<T>::destroy() noexcept {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (ctrl_[i] >= 0) {
+                slots_[i].~value_type();
+            }
+        }
+        if (slots_ != nullptr) {
+            allocator_type(resource_).deallocate(slots_, capacity_);
+        }
+        if (ctrl_ != nullptr) {
+            std::pmr::polymorphic_allocator<int8_t>(resource_).deallocate(ctrl_, capacity_);
+        }
+        ctrl_ = nullptr;
+        slots_ = nullptr;
+        capacity_ = 0;
+        size_ = 0;
+        deleted_ = 0;
+    }
+
+    template<typename T>
+    typename flat_map<T>::iterator flat_map<T>::iterator_at(size_t index) {
+        return iterator(ctrl_ + index, ctrl_ + capacity_, slots_ + index);
+    }
+
+    // Builds the entry with uses-allocator construction, so the key and an
+    // allocator-aware value share the resource of the map.
+    template<typename T>
+    template<typename... Args>
+    void flat_map<T>::construct_at(size_t index, size_t hash, Args&&... args) {
+        allocator_type(resource_).construct(slots_ + index, std::forward<Args>(args)...);
+        ctrl_[index] = control(hash);
+        ++size_;
+    }
+
+    template<typename T>
+    bool operator==(flat_map<T> const& lhs, flat_map<T> const& rhs) {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (auto const& [key, value] : lhs) {
+            auto it = rhs.find(key);
+            if (it == rhs.end() || !(it->second == value)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template<typename T>
+    bool operator!=(flat_map<T> const& lhs, flat_map<T> const& rhs) {
+        return !(lhs == rhs);
+    }
+
+    template<typename T>
+    void swap(flat_map<T>& lhs, flat_map<T>& rhs) noexcept {
+        lhs.swap(rhs);
+    }
+}
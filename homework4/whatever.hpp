@@ -1,11 +1,19 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <exception>
 #include <initializer_list>
 #include <memory>
+#include <memory_resource>
+#include <new>
 #include <string>
-#include <unordered_map>
+#include <type_traits>
+#include <typeinfo>
 #include <utility>
+#include <vector>
+
+#include "flat_map.hpp"
 
 namespace utils {
     struct bad_whatever_cast : public std::exception {
@@ -14,24 +22,79 @@ namespace utils {
         }
     };
 
+    // Builds T with the memory resource if T is allocator-aware, like
+    // std::pmr containers do for their elements.
+    template<typename T, typename... Args>
+    T make_with_resource(std::pmr::memory_resource* resource, Args&&... args) {
+        typedef std::pmr::polymorphic_allocator<std::byte> allocator;
+        if constexpr (!std::uses_allocator_v<T, allocator>) {
+            return T(std::forward<Args>(args)...);
+        } else if constexpr (std::is_constructible_v<T, std::allocator_arg_t, allocator, Args...>) {
+            return T(std::allocator_arg, allocator(resource), std::forward<Args>(args)...);
+        } else {
+            return T(std::forward<Args>(args)..., allocator(resource));
+        }
+    }
+
+    template<typename... Ts>
+    struct type_list {};
+
+    // Position of T in the list, or the size of the list if T is not in it.
+    template<typename T, typename List>
+    struct type_index;
+
+    template<typename T>
+    struct type_index<T, type_list<>> : std::integral_constant<size_t, 0> {};
+
+    template<typename T, typename U, typename... Us>
+    struct type_index<T, type_list<U, Us...>>
+        : std::integral_constant<size_t, std::is_same_v<T, U> ? 0 : 1 + type_index<T, type_list<Us...>>::value> {};
+
+    // Values that do not fit into the inline storage are allocated from the
+    // memory resource of the whatever, and allocator-aware values (dict_t,
+    // array_t) are built with it too, so a whole tree can share one arena.
+    // std::string and std::vector values are not allocator-aware: their
+    // holders come from the resource, but the characters of strings longer
+    // than the small-string buffer and the elements of vectors still come
+    // from the global heap. They stay std::string and std::vector so that
+    // get<std::string> and get<std::vector<int>> keep working.
+    // Like std::pmr containers, a copy uses the default resource, a move
+    // keeps the resource and assignment never changes it.
     struct whatever {
     public:
+        typedef std::pmr::polymorphic_allocator<std::byte> allocator_type;
+
         whatever();
-        whatever(std::initializer_list<std::pair<std::string const, whatever>> list);
+        whatever(std::initializer_list<std::pair<std::pmr::string const, whatever>> list);
 
         whatever(whatever const& other);
         whatever& operator=(whatever const& other);
 
         whatever(whatever&& other) noexcept;
-        whatever& operator=(whatever&& other) noexcept;
+        whatever& operator=(whatever&& other);
 
         ~whatever();
 
-        template<typename T> whatever(T const& obj);
-        template<typename T> whatever& operator=(T const& obj);
+        // Never chosen for whatever itself, so a non-const whatever is copied
+        // rather than wrapped into another one.
+        template<typename T, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, whatever>>>
+        whatever(T const& obj);
+        template<typename T, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, whatever>>>
+        whatever& operator=(T const& obj);
+
+        template<typename T, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, whatever>>>
+        explicit whatever(T&& obj);
+        template<typename T, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, whatever>>>
+        whatever& operator=(T&& obj);
+
+        whatever(std::allocator_arg_t, allocator_type const& allocator);
+        whatever(std::allocator_arg_t, allocator_type const& allocator, whatever const& other);
+        whatever(std::allocator_arg_t, allocator_type const& allocator, whatever&& other);
 
-        template<typename T> explicit whatever(T&& obj);
-        template<typename T> whatever& operator=(T&& obj);
+        template<typename T, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, whatever>>>
+        whatever(std::allocator_arg_t, allocator_type const& allocator, T&& obj);
+
+        allocator_type get_allocator() const;
 
         void swap(whatever& other);
 
@@ -39,26 +102,110 @@ namespace utils {
         bool empty() const;
         void clear();
 
+        // Calls f with the held value if its type is one of Ts.
+        // Returns false if the value is empty or of any other type. If all
+        // of Ts are among visited_types, this is one table lookup.
+        template<typename... Ts, typename F> bool visit(F&& f);
+        template<typename... Ts, typename F> bool visit(F&& f) const;
+
         template<typename T> friend T* whatever_cast(whatever* operand);
         template<typename T> friend T whatever_cast(whatever& operand);
 
         friend bool operator==(whatever const& lhs, whatever const& rhs);
 
     private:
+        // Small nothrow-movable values live in storage_, the rest on the heap.
+        static constexpr size_t SMALL_SIZE = 5 * sizeof(void*);
+
+        // The value types of dicts, which visit dispatches with a table.
+        typedef type_list<bool, char, short, int, long, unsigned char, unsigned short, unsigned int,
+            unsigned long, float, double, std::string, flat_map<whatever>, std::pmr::vector<whatever>,
+            std::vector<bool>, std::vector<char>, std::vector<short>, std::vector<int>, std::vector<long>,
+            std::vector<unsigned char>, std::vector<unsigned short>, std::vector<unsigned int>,
+            std::vector<unsigned long>, std::vector<float>, std::vector<double>,
+            std::vector<std::string>> visited_types;
+
+        template<typename T>
+        static constexpr size_t visited_index = type_index<T, visited_types>::value;
+
+        static constexpr size_t VISITED_COUNT = visited_index<void>;
+
+        // One static object per type, its address identifies the type without
+        // going through std::type_info. It holds the position of the type in
+        // visited_types, or VISITED_COUNT for other types.
+        template<typename T>
+        struct type_tag {
+            static constexpr unsigned char index = visited_index<T>;
+        };
+
+        template<typename T>
+        static constexpr void const* type_id() noexcept {
+            return &type_tag<typename std::remove_cv<T>::type>::index;
+        }
+
         struct base_holder {
+            explicit base_holder(void const* type) noexcept : type_(type) {}
             virtual ~base_holder() = default;
-            virtual base_holder* clone() const = 0;
+            virtual base_holder* clone(void* storage, std::pmr::memory_resource* resource) const = 0;
+            virtual base_holder* move_to(void* storage, std::pmr::memory_resource* resource) = 0;
+            virtual base_holder* relocate(void* storage) noexcept = 0;
+            virtual void destroy(std::pmr::memory_resource* resource) noexcept = 0;
+            virtual bool is_inline() const noexcept = 0;
             virtual const std::type_info& type_info() const = 0;
             virtual bool is_equal(base_holder* other) const = 0;
+
+            void const* const type_;
         };
 
         template<typename T>
         struct holder : base_holder {
-            explicit holder(T const& value) : value_(value) {}
-            explicit holder(T&& value) noexcept : value_(std::move(value)) {}
+            // Allocator-aware values always go to the memory resource.
+            static constexpr bool fits_inline = sizeof(T) + sizeof(base_holder) <= SMALL_SIZE
+                && alignof(T) <= alignof(std::max_align_t)
+                && std::is_nothrow_move_constructible<T>::value
+                && !std::uses_allocator_v<T, allocator_type>;
+
+            template<typename U>
+            holder(std::pmr::memory_resource* resource, U&& value)
+                : base_holder(type_id<T>()), value_(make_with_resource<T>(resource, std::forward<U>(value))) {}
+
+            template<typename U>
+            static base_holder* create(void* storage, std::pmr::memory_resource* resource, U&& value) {
+                if constexpr (fits_inline) {
+                    static_assert(sizeof(holder) <= SMALL_SIZE, "holder does not fit into inline storage");
+                    return new (storage) holder(resource, std::forward<U>(value));
+                } else {
+                    void* memory = resource->allocate(sizeof(holder), alignof(holder));
+                    try {
+                        return new (memory) holder(resource, std::forward<U>(value));
+                    } catch (...) {
+                        resource->deallocate(memory, sizeof(holder), alignof(holder));
+                        throw;
+                    }
+                }
+            }
+
+            base_holder* clone(void* storage, std::pmr::memory_resource* resource) const override {
+                return create(storage, resource, value_);
+            }
+
+            base_holder* move_to(void* storage, std::pmr::memory_resource* resource) override {
+                return create(storage, resource, std::move(value_));
+            }
+
+            base_holder* relocate(void* storage) noexcept override {
+                return new (storage) holder(nullptr, std::move(value_));
+            }
 
-            base_holder* clone() const override {
-                return new holder(value_);
+            void destroy(std::pmr::memory_resource* resource) noexcept override {
+                this->~holder();
+                if constexpr (!fits_inline) {
+                    resource->deallocate(this, sizeof(holder), alignof(holder));
+                }
+            }
+
+            bool is_inline() const noexcept override {
+                return fits_inline;
             }
 
             std::type_info const& type_info() const override {
@@ -66,60 +213,130 @@ namespace utils {
             }
 
             bool is_equal(base_holder* other) const override {
-                return (type_info() == other->type_info())
+                return (type_ == other->type_)
                     && (value_ == static_cast<holder<T>*>(other)->value_);
             }
 
             T value_;
         };
 
-        std::unique_ptr<base_holder> data_;
+        template<typename T> bool holds() const noexcept;
+
+        template<typename Base, typename F>
+        using visit_call = void (*)(Base* data, F& f);
+
+        template<typename U, typename Base, typename F>
+        static void visit_one(Base* data, F& f) {
+            typedef std::conditional_t<std::is_const_v<Base>, holder<U> const, holder<U>> holder_type;
+            f(static_cast<holder_type*>(data)->value_);
+        }
+
+        template<typename U, typename Base, typename F, typename... Ts>
+        static constexpr visit_call<Base, F> visit_entry() {
+            if constexpr ((std::is_same_v<U, Ts> || ...)) {
+                return &visit_one<U, Base, F>;
+            } else {
+                return nullptr;
+            }
+        }
+
+        // Entry i calls f with the i-th type of visited_types if it is one
+        // of Ts. The last entry, for all other types, is empty.
+        template<typename Base, typename F, typename... Ts, typename... Us>
+        static constexpr std::array<visit_call<Base, F>, VISITED_COUNT + 1> visit_table(type_list<Us...>) {
+            return {{visit_entry<Us, Base, F, Ts...>()..., nullptr}};
+        }
+
+        template<typename Base, typename... Ts, typename F>
+        static bool dispatch(Base* data, F& f);
+
+        void reset() noexcept;
+        void move_from(whatever& other) noexcept;
+
+        alignas(std::max_align_t) unsigned char storage_[SMALL_SIZE];
+        std::pmr::memory_resource* resource_ = std::pmr::get_default_resource();
+        base_holder* data_ = nullptr;
     };
 
     inline whatever::whatever() : data_(nullptr) {}
 
-    inline whatever::whatever(std::initializer_list<std::pair<std::string const, whatever>> list) {
-        whatever(std::unordered_map<std::string, whatever>(list));
-    }
+    inline whatever::whatever(std::initializer_list<std::pair<std::pmr::string const, whatever>> list)
+        : whatever(flat_map<whatever>(list)) {}
 
     inline whatever::whatever(whatever const& other) 
-        : data_(other.data_ ? other.data_->clone() : nullptr) {}
+        : data_(other.data_ ? other.data_->clone(storage_, resource_) : nullptr) {}
 
     inline whatever& whatever::operator=(whatever const& other) {
-        whatever(other).swap(*this);
+        *this = whatever(std::allocator_arg, resource_, other);
         return *this;
     }
 
-    inline whatever::whatever(whatever&& other) noexcept
-        : data_(std::move(other.data_)) {}
+    inline whatever::whatever(whatever&& other) noexcept : resource_(other.resource_) {
+        move_from(other);
+    }
 
-    inline whatever& whatever::operator=(whatever&& other) noexcept {
-        whatever(std::move(other)).swap(*this);
+    // Values from another resource are moved into a new holder from ours.
+    inline whatever& whatever::operator=(whatever&& other) {
+        if (this == &other) {
+            return *this;
+        }
+        if (other.data_ != nullptr && !other.data_->is_inline() && other.resource_ != resource_) {
+            return *this = whatever(std::allocator_arg, resource_, std::move(other));
+        }
+        reset();
+        move_from(other);
         return *this;
     }
 
-    inline whatever::~whatever() {}
+    inline whatever::~whatever() {
+        reset();
+    }
 
-    template<typename T> 
-    whatever::whatever(T const& obj) 
-        : data_(new holder<typename std::decay<T>::type>(obj)) {}
+    template<typename T, typename>
+    whatever::whatever(T const& obj)
+        : data_(holder<typename std::decay<T>::type>::create(storage_, resource_, obj)) {}
 
-    template<typename T> 
+    template<typename T, typename>
     whatever& whatever::operator=(T const& obj) {
-        whatever(obj).swap(*this);
+        *this = whatever(std::allocator_arg, resource_, obj);
         return *this;
     }
 
-    template<typename T> 
-    whatever::whatever(T&& obj) 
-        : data_(new holder<typename std::decay<T>::type>(std::forward<T>(obj))) {}
+    template<typename T, typename>
+    whatever::whatever(T&& obj)
+        : data_(holder<typename std::decay<T>::type>::create(storage_, resource_, std::forward<T>(obj))) {}
 
-    template<typename T> 
+    template<typename T, typename>
     whatever& whatever::operator=(T&& obj) {
-        whatever(std::forward<T>(obj)).swap(*this);
+        *this = whatever(std::allocator_arg, resource_, std::forward<T>(obj));
         return *this;
     }
 
+    inline whatever::whatever(std::allocator_arg_t, allocator_type const& allocator)
+        : resource_(allocator.resource()), data_(nullptr) {}
+
+    inline whatever::whatever(std::allocator_arg_t, allocator_type const& allocator, whatever const& other)
+        : resource_(allocator.resource()), data_(other.data_ ? other.data_->clone(storage_, resource_) : nullptr) {}
+
+    inline whatever::whatever(std::allocator_arg_t, allocator_type const& allocator, whatever&& other)
+        : resource_(allocator.resource()) {
+        if (other.data_ != nullptr && !other.data_->is_inline() && other.resource_ != resource_) {
+            data_ = other.data_->move_to(storage_, resource_);
+            other.reset();
+        } else {
+            move_from(other);
+        }
+    }
+
+    template<typename T, typename>
+    whatever::whatever(std::allocator_arg_t, allocator_type const& allocator, T&& obj)
+        : resource_(allocator.resource()),
+          data_(holder<typename std::decay<T>::type>::create(storage_, resource_, std::forward<T>(obj))) {}
+
+    inline whatever::allocator_type whatever::get_allocator() const {
+        return resource_;
+    }
+
     inline std::type_info const& whatever::type_info() const {
         return data_->type_info();
     }
@@ -129,11 +346,70 @@ namespace utils {
     }
 
     inline void whatever::clear() {
-        whatever().swap(*this);
+        reset();
     }
 
     inline void whatever::swap(whatever& other) {
-        std::swap(data_, other.data_);
+        if (this == &other) {
+            return;
+        }
+        whatever tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+    template<typename... Ts, typename F>
+    bool whatever::visit(F&& f) {
+        return dispatch<base_holder, Ts...>(data_, f);
+    }
+
+    template<typename... Ts, typename F>
+    bool whatever::visit(F&& f) const {
+        return dispatch<base_holder const, Ts...>(data_, f);
+    }
+
+    template<typename Base, typename... Ts, typename F>
+    bool whatever::dispatch(Base* data, F& f) {
+        if (data == nullptr) {
+            return false;
+        }
+        if constexpr (((visited_index<Ts> < VISITED_COUNT) && ...)) {
+            static constexpr auto table = visit_table<Base, F, Ts...>(visited_types());
+            visit_call<Base, F> call = table[*static_cast<unsigned char const*>(data->type_)];
+            if (call == nullptr) {
+                return false;
+            }
+            call(data, f);
+            return true;
+        } else {
+            return ((data->type_ == type_id<Ts>() && (visit_one<Ts>(data, f), true)) || ...);
+        }
+    }
+
+    template<typename T>
+    bool whatever::holds() const noexcept {
+        return data_ != nullptr && data_->type_ == type_id<T>();
+    }
+
+    inline void whatever::reset() noexcept {
+        if (data_ == nullptr) {
+            return;
+        }
+        data_->destroy(resource_);
+        data_ = nullptr;
+    }
+
+    // Takes the value of other, which is inline or from the same resource.
+    inline void whatever::move_from(whatever& other) noexcept {
+        if (other.data_ == nullptr) {
+            data_ = nullptr;
+        } else if (other.data_->is_inline()) {
+            data_ = other.data_->relocate(storage_);
+            other.reset();
+        } else {
+            data_ = other.data_;
+            other.data_ = nullptr;
+        }
     }
 
     inline void swap(whatever& lhs, whatever& rhs) {
@@ -142,8 +418,9 @@ namespace utils {
 
     template<typename T>
     T* whatever_cast(whatever* operand) {
-        if (operand && operand->data_ && operand->data_->type_info() == typeid(T)) {
-            return &static_cast<whatever::holder<T>*>(operand->data_.get())->value_;
+        typedef typename std::remove_cv<T>::type unqualified;
+        if (operand && operand->template holds<unqualified>()) {
+            return &static_cast<whatever::holder<unqualified>*>(operand->data_)->value_;
         } else {
             return nullptr;
         }
@@ -157,8 +434,8 @@ namespace utils {
     template<typename T> 
     T whatever_cast(whatever& operand) {
         typedef typename std::decay<T>::type decayed;
-        if (operand.data_->type_info() == typeid(decayed)) {
-            return static_cast<whatever::holder<decayed>*>(operand.data_.get())->value_;
+        if (operand.template holds<decayed>()) {
+            return static_cast<whatever::holder<decayed>*>(operand.data_)->value_;
         } else {
             throw bad_whatever_cast();
         }
@@ -171,6 +448,6 @@ namespace utils {
     }
 
     inline bool operator==(whatever const& lhs, whatever const& rhs) {
-        return (lhs.empty() && rhs.empty()) || (lhs.data_.get()->is_equal(rhs.data_.get()));
+        return (lhs.empty() && rhs.empty()) || (!lhs.empty() && !rhs.empty() && lhs.data_->is_equal(rhs.data_));
     }
 }